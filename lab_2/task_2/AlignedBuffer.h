@@ -0,0 +1,21 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+// Байтовый буфер, выровненный на kBufferAlignment байт (строка кэша), - общее хранилище
+// PixelBuffer (в том числе плоского режима) и bmp::Bitmap
+constexpr size_t kBufferAlignment = 64;
+
+struct AlignedDelete {
+    void operator()(uint8_t* p) const { ::operator delete[](p, std::align_val_t(kBufferAlignment)); }
+};
+
+using AlignedBytes = std::unique_ptr<uint8_t[], AlignedDelete>;
+
+// Неинициализированный буфер; пустой запрос даёт 1 байт, чтобы указатель был валиден
+inline AlignedBytes AllocateAligned(size_t bytes) {
+    return AlignedBytes(static_cast<uint8_t*>(::operator new[](std::max<size_t>(bytes, 1), std::align_val_t(kBufferAlignment))));
+}
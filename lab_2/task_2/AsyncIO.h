@@ -0,0 +1,392 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "FileIO.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define ASYNC_IO_URING 1
+#include <cerrno>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+// Асинхронные чтения и записи по смещению. Submit* ставит запрос в очередь и сразу
+// возвращается; Wait ждёт завершения любого из запросов и возвращает его метку tag.
+// Буфер запроса должен жить до его завершения. Запрос выполняется целиком (короткие
+// чтения и записи дочитываются сами), ошибка - исключение из Wait.
+class AsyncIO {
+public:
+    virtual ~AsyncIO() = default;
+    virtual const char* Name() const = 0;
+    virtual void SubmitRead(const PositionalFile& file, void* buffer, uint64_t size, uint64_t offset, uint64_t tag) = 0;
+    virtual void SubmitWrite(const PositionalFile& file, const void* buffer, uint64_t size, uint64_t offset, uint64_t tag) = 0;
+    virtual uint64_t Wait() = 0;
+};
+
+enum class AsyncIOBackend {
+    Auto,
+    Uring,
+    Threads
+};
+
+inline bool ParseAsyncIOBackend(const std::string& name, AsyncIOBackend& backend) {
+    if (name == "auto") {
+        backend = AsyncIOBackend::Auto;
+    } else if (name == "uring") {
+        backend = AsyncIOBackend::Uring;
+    } else if (name == "threads") {
+        backend = AsyncIOBackend::Threads;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Переносимый вариант: запросы выполняют несколько потоков обычными ReadAt/WriteAt
+class ThreadAsyncIO : public AsyncIO {
+public:
+    explicit ThreadAsyncIO(unsigned numThreads = 2) {
+        for (unsigned i = 0; i < numThreads; ++i) {
+            workers.emplace_back([this] { WorkerLoop(); });
+        }
+    }
+
+    ~ThreadAsyncIO() override {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        requestCv.notify_all();
+    }
+
+    const char* Name() const override { return "threads"; }
+
+    void SubmitRead(const PositionalFile& file, void* buffer, uint64_t size, uint64_t offset, uint64_t tag) override {
+        Push(Request{ &file, static_cast<uint8_t*>(buffer), size, offset, tag, false });
+    }
+
+    void SubmitWrite(const PositionalFile& file, const void* buffer, uint64_t size, uint64_t offset, uint64_t tag) override {
+        Push(Request{ &file, const_cast<uint8_t*>(static_cast<const uint8_t*>(buffer)), size, offset, tag, true });
+    }
+
+    uint64_t Wait() override {
+        std::unique_lock<std::mutex> lock(mtx);
+        doneCv.wait(lock, [this] { return !done.empty() || error; });
+        if (error) {
+            std::rethrow_exception(std::exchange(error, nullptr));
+        }
+        uint64_t tag = done.front();
+        done.pop_front();
+        return tag;
+    }
+
+private:
+    struct Request {
+        const PositionalFile* file;
+        uint8_t* buffer;
+        uint64_t size;
+        uint64_t offset;
+        uint64_t tag;
+        bool write;
+    };
+
+    std::mutex mtx;
+    std::condition_variable requestCv;
+    std::condition_variable doneCv;
+    std::deque<Request> requests;
+    std::deque<uint64_t> done;
+    std::exception_ptr error;
+    bool stopping = false;
+    std::vector<std::jthread> workers;
+
+    void Push(const Request& request) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            requests.push_back(request);
+        }
+        requestCv.notify_one();
+    }
+
+    void WorkerLoop() {
+        for (;;) {
+            Request request;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                requestCv.wait(lock, [this] { return stopping || !requests.empty(); });
+                if (requests.empty()) {
+                    return;
+                }
+                request = requests.front();
+                requests.pop_front();
+            }
+            try {
+                if (request.write) {
+                    request.file->WriteAt(request.buffer, request.size, request.offset);
+                } else {
+                    request.file->ReadAt(request.buffer, request.size, request.offset);
+                }
+                std::lock_guard<std::mutex> lock(mtx);
+                done.push_back(request.tag);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mtx);
+                error = std::current_exception();
+            }
+            doneCv.notify_one();
+        }
+    }
+};
+
+#ifdef ASYNC_IO_URING
+
+// io_uring через системные вызовы (без liburing): кольцо запросов (SQ) и кольцо
+// завершений (CQ) общие с ядром, io_uring_enter отправляет запросы и ждёт завершений.
+// Одновременно в работе не больше depth запросов. Конструктор проверяет через
+// IORING_REGISTER_PROBE, что ядро умеет IORING_OP_READ/WRITE (5.6+): на 5.1-5.5
+// io_uring_setup проходит, а сами операции завершались бы с EINVAL.
+class UringAsyncIO : public AsyncIO {
+public:
+    explicit UringAsyncIO(unsigned depth) : slots(depth) {
+        try {
+            Setup(depth);
+        } catch (...) {
+            Release();
+            throw;
+        }
+    }
+
+    ~UringAsyncIO() override {
+        Drain();
+        Release();
+    }
+
+    const char* Name() const override { return "io_uring"; }
+
+    void SubmitRead(const PositionalFile& file, void* buffer, uint64_t size, uint64_t offset, uint64_t tag) override {
+        Start(Slot{ file.NativeHandle(), static_cast<uint8_t*>(buffer), size, offset, tag, false, true });
+    }
+
+    void SubmitWrite(const PositionalFile& file, const void* buffer, uint64_t size, uint64_t offset, uint64_t tag) override {
+        Start(Slot{ file.NativeHandle(), const_cast<uint8_t*>(static_cast<const uint8_t*>(buffer)), size, offset, tag, true, true });
+    }
+
+    uint64_t Wait() override {
+        for (;;) {
+            uint32_t head = *cqHead;
+            if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+                if (syscall(__NR_io_uring_enter, ring, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+                    throw std::runtime_error("io_uring_enter failed: " + std::string(std::strerror(errno)));
+                }
+                continue;
+            }
+            io_uring_cqe cqe = cqes[head & cqMask];
+            __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+
+            Slot& slot = slots[cqe.user_data];
+            if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+                Queue(cqe.user_data);
+                continue;
+            }
+            if (cqe.res <= 0) {
+                slot.busy = false;
+                throw std::runtime_error(cqe.res == 0 ? "Unexpected end of file." :
+                    std::string(slot.write ? "Write failed: " : "Read failed: ") + std::strerror(-cqe.res));
+            }
+            // Короткая операция - продолжаем с того места, где она остановилась
+            slot.buffer += cqe.res;
+            slot.size -= uint64_t(cqe.res);
+            slot.offset += uint64_t(cqe.res);
+            if (slot.size > 0) {
+                Queue(cqe.user_data);
+                continue;
+            }
+            slot.busy = false;
+            return slot.tag;
+        }
+    }
+
+private:
+    struct Slot {
+        int fd;
+        uint8_t* buffer;
+        uint64_t size;
+        uint64_t offset;
+        uint64_t tag;
+        bool write;
+        bool busy;
+    };
+
+    int ring = -1;
+    void* sqRing = nullptr;
+    void* cqRing = nullptr;
+    size_t sqSize = 0, cqSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    unsigned sqeCount = 0;
+    uint32_t* sqTail = nullptr;
+    uint32_t sqMask = 0;
+    uint32_t* sqArray = nullptr;
+    uint32_t* cqHead = nullptr;
+    uint32_t* cqTail = nullptr;
+    uint32_t cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+    std::vector<Slot> slots;
+
+    void Setup(unsigned depth) {
+        io_uring_params params{};
+        ring = int(syscall(__NR_io_uring_setup, depth, &params));
+        if (ring < 0) {
+            throw std::runtime_error("io_uring is not available: " + std::string(std::strerror(errno)));
+        }
+        sqSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) {
+            sqSize = cqSize = std::max(sqSize, cqSize);
+        }
+        sqRing = Map(sqSize, IORING_OFF_SQ_RING);
+        cqRing = single ? sqRing : Map(cqSize, IORING_OFF_CQ_RING);
+        sqes = static_cast<io_uring_sqe*>(Map(params.sq_entries * sizeof(io_uring_sqe), IORING_OFF_SQES));
+        sqeCount = params.sq_entries;
+
+        uint8_t* sq = static_cast<uint8_t*>(sqRing);
+        sqTail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+        uint8_t* cq = static_cast<uint8_t*>(cqRing);
+        cqHead = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        Probe();
+    }
+
+    void Probe() {
+        const size_t size = sizeof(io_uring_probe) + IORING_OP_LAST * sizeof(io_uring_probe_op);
+        std::vector<uint64_t> storage((size + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+        io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+        if (syscall(__NR_io_uring_register, ring, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0) {
+            throw std::runtime_error("io_uring probe is not available: " + std::string(std::strerror(errno)));
+        }
+        for (int op : { IORING_OP_READ, IORING_OP_WRITE }) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                throw std::runtime_error("io_uring does not support plain reads and writes.");
+            }
+        }
+    }
+
+    // Ядро пишет в буферы запросов, пока они в работе, поэтому перед закрытием кольца
+    // (в том числе после ошибки из Wait) дожидаемся всех оставшихся завершений.
+    void Drain() {
+        if (ring < 0) {
+            return;
+        }
+        size_t inFlight = std::count_if(slots.begin(), slots.end(), [](const Slot& slot) { return slot.busy; });
+        while (inFlight > 0) {
+            uint32_t head = *cqHead;
+            if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+                if (syscall(__NR_io_uring_enter, ring, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+                    return;
+                }
+                continue;
+            }
+            slots[cqes[head & cqMask].user_data].busy = false;
+            __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+            --inFlight;
+        }
+    }
+
+    void Release() {
+        if (sqes) {
+            munmap(sqes, sqeCount * sizeof(io_uring_sqe));
+        }
+        if (cqRing && cqRing != sqRing) {
+            munmap(cqRing, cqSize);
+        }
+        if (sqRing) {
+            munmap(sqRing, sqSize);
+        }
+        if (ring >= 0) {
+            close(ring);
+        }
+        sqes = nullptr;
+        sqRing = cqRing = nullptr;
+        ring = -1;
+    }
+
+    void* Map(size_t size, uint64_t offset) {
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, off_t(offset));
+        if (p == MAP_FAILED) {
+            throw std::runtime_error("Could not map io_uring rings.");
+        }
+        return p;
+    }
+
+    void Start(const Slot& request) {
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (!slots[i].busy) {
+                slots[i] = request;
+                Queue(i);
+                return;
+            }
+        }
+        throw std::runtime_error("Too many io_uring requests in flight.");
+    }
+
+    // Запрос слота index (его оставшаяся часть) - в кольцо и в ядро
+    void Queue(size_t index) {
+        const Slot& slot = slots[index];
+        uint32_t tail = *sqTail;
+        uint32_t at = tail & sqMask;
+        io_uring_sqe& sqe = sqes[at];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = slot.write ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe.fd = slot.fd;
+        sqe.addr = reinterpret_cast<uint64_t>(slot.buffer);
+        sqe.len = uint32_t(std::min<uint64_t>(slot.size, 1u << 30));
+        sqe.off = slot.offset;
+        sqe.user_data = index;
+        sqArray[at] = at;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        while (syscall(__NR_io_uring_enter, ring, 1, 0, 0, nullptr, 0) < 0) {
+            if (errno != EINTR && errno != EAGAIN) {
+                // Запрос не ушёл в ядро - ждать его завершения в Drain не нужно
+                slots[index].busy = false;
+                throw std::runtime_error("io_uring_enter failed: " + std::string(std::strerror(errno)));
+            }
+        }
+    }
+};
+
+#endif // ASYNC_IO_URING
+
+// Auto - io_uring, если он есть в системе, разрешён и умеет обычные чтения и записи
+// (ядро 5.6+, см. UringAsyncIO::Probe), иначе потоки
+inline std::unique_ptr<AsyncIO> CreateAsyncIO(AsyncIOBackend backend, unsigned depth) {
+#ifdef ASYNC_IO_URING
+    if (backend != AsyncIOBackend::Threads) {
+        try {
+            return std::make_unique<UringAsyncIO>(depth);
+        } catch (const std::exception&) {
+            if (backend == AsyncIOBackend::Uring) {
+                throw;
+            }
+        }
+    }
+#else
+    if (backend == AsyncIOBackend::Uring) {
+        throw std::runtime_error("io_uring is not supported on this platform.");
+    }
+#endif
+    return std::make_unique<ThreadAsyncIO>();
+}
@@ -1,14 +1,17 @@
-﻿#include <iostream>
+﻿#pragma once
+#include <iostream>
 #include <fstream>
 #include <vector>
 #include <thread>
+#include <algorithm>
+#include <atomic>
+#include <barrier>
 #include <random>
 #include <string>
 #include <cstdint>
-
-struct Pixel {
-    uint8_t blue, green, red;
-};
+#include <cstring>
+#include "MappedBMP.h"
+#include "PixelBuffer.h"
 
 class BMPImage {
 public:
@@ -30,68 +33,155 @@ public:
         }
     }
 
-    void Save(const std::string& outputFilePath) const {
-        std::ofstream outFile(outputFilePath, std::ios::binary);
-        if (!outFile) throw std::runtime_error("Could not open file for writing.");
+    // Детерминированный вариант: squareCount квадратов задаются только seed, результат
+    // побайтно совпадает с последовательным наложением квадратов по порядку при любом
+    // числе потоков. Квадрат читает своё окружение и пишет результат через отдельный
+    // буфер, а квадраты, задевающие друг друга (с учётом ореола в 1 пиксель), выполняются
+    // строго по порядку: каждый попадает в волну на 1 позже последней пересекающейся с ним.
+    // Квадраты одной волны не пересекаются и размываются параллельно.
+    void BlurDeterministic(unsigned threadCount, uint32_t seed, unsigned squareCount, unsigned squareSize) {
+        squareSize = std::min<unsigned>({ squareSize, unsigned(width), unsigned(height) });
+        if (squareSize == 0 || squareCount == 0) {
+            return;
+        }
+        std::vector<Square> squares = MakeSquares(seed, squareCount, squareSize);
+        std::vector<std::vector<unsigned>> waves = ScheduleWaves(squares);
+
+        threadCount = std::max(threadCount, 1u);
+        std::barrier sync(threadCount);
+        auto worker = [&](unsigned t) {
+            std::vector<Pixel> scratch(size_t(squareSize) * squareSize);
+            for (const std::vector<unsigned>& wave : waves) {
+                for (size_t i = t; i < wave.size(); i += threadCount) {
+                    BlurSquareBuffered(squares[wave[i]], scratch);
+                }
+                sync.arrive_and_wait();
+            }
+        };
 
-        outFile.write(reinterpret_cast<const char*>(&fileHeader), sizeof(fileHeader));
-        outFile.write(reinterpret_cast<const char*>(&infoHeader), sizeof(infoHeader));
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < threadCount; ++i) {
+            threads.emplace_back(worker, i);
+        }
+        worker(0);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    // Представление в памяти: размытие работает с обоими, файл пишется в чередующемся
+    void SetLayout(PixelLayout layout) { pixels.SetLayout(layout); }
+    PixelLayout Layout() const { return pixels.Layout(); }
+    PixelBuffer& Pixels() { return pixels; }
 
-        for (const auto& row : pixels) {
-            outFile.write(reinterpret_cast<const char*>(row.data()), row.size() * sizeof(Pixel));
+    void Save(const std::string& outputFilePath) {
+        PixelLayout layout = pixels.Layout();
+        pixels.SetLayout(PixelLayout::Interleaved);
+        MappedBMP outFile = MappedBMP::Create(outputFilePath, width, height, infoHeader.height < 0);
+        ImageView view = outFile.Pixels();
+        for (int y = 0; y < height; ++y) {
+            std::memcpy(view.Row(y), pixels.Row(y), width * sizeof(Pixel));
         }
+        pixels.SetLayout(layout);
     }
 
 private:
-    struct BMPFileHeader {
-        uint16_t fileType{ 0x4D42 };
-        uint32_t fileSize{ 0 };
-        uint32_t reserved{ 0 };
-        uint32_t dataOffset{ 0 };
-    } fileHeader;
-
-    struct BMPInfoHeader {
-        uint32_t headerSize{ 0 };
-        int32_t width{ 0 };
-        int32_t height{ 0 };
-        uint16_t planes{ 1 };
-        uint16_t bitCount{ 24 };
-        uint32_t compression{ 0 };
-        uint32_t imageSize{ 0 };
-        int32_t xPixelsPerMeter{ 0 };
-        int32_t yPixelsPerMeter{ 0 };
-        uint32_t colorsUsed{ 0 };
-        uint32_t importantColors{ 0 };
-    } infoHeader;
-
-    std::vector<std::vector<Pixel>> pixels;
+    BMPHeader fileHeader{};
+    DIBHeader infoHeader{};
+
+    PixelBuffer pixels;
     int width;
     int height;
 
+    // Строки читаются прямо из отображения файла; pixels[0] - верхняя строка
     void Load(const std::string& filePath) {
-        std::ifstream inFile(filePath, std::ios::binary);
-        if (!inFile) throw std::runtime_error("Could not open file for reading.");
+        MappedBMP inFile = MappedBMP::Open(filePath);
+        fileHeader = inFile.Header();
+        infoHeader = inFile.Info();
 
-        inFile.read(reinterpret_cast<char*>(&fileHeader), sizeof(fileHeader));
-        inFile.read(reinterpret_cast<char*>(&infoHeader), sizeof(infoHeader));
+        width = inFile.Width();
+        height = inFile.Height();
 
-        if (fileHeader.fileType != 0x4D42) {
-            throw std::runtime_error("Not a BMP file.");
+        ImageView view = inFile.Pixels();
+        pixels = PixelBuffer(width, height);
+        for (int y = 0; y < height; ++y) {
+            std::memcpy(pixels.Row(y), view.Row(y), width * sizeof(Pixel));
         }
+    }
 
-        width = infoHeader.width;
-        height = infoHeader.height;
-
-        if (width <= 0 || height <= 0) {
-            throw std::runtime_error("Invalid BMP dimensions.");
+    struct Square {
+        int x0, y0, size;
+    };
+
+    // Генератор mt19937 и взятие по модулю вместо std::uniform_int_distribution: её
+    // реализация своя у каждой стандартной библиотеки, а квадраты должны совпадать везде
+    std::vector<Square> MakeSquares(uint32_t seed, unsigned count, unsigned size) const {
+        std::mt19937 generator(seed);
+        std::vector<Square> squares(count);
+        for (Square& square : squares) {
+            square.x0 = int(generator() % (width - size + 1));
+            square.y0 = int(generator() % (height - size + 1));
+            square.size = int(size);
         }
+        return squares;
+    }
 
-        pixels.resize(height, std::vector<Pixel>(width));
+    // Волны зависимостей. Квадраты i < j зависимы, если j пишет туда, откуда читает i,
+    // или читает то, что i пишет: прямоугольники, расширенные на 1, пересекаются.
+    // Кандидаты ищутся по сетке ячеек со стороной в размер квадрата.
+    std::vector<std::vector<unsigned>> ScheduleWaves(const std::vector<Square>& squares) const {
+        const int cell = squares.front().size + 2;
+        const int cellsX = (width + cell - 1) / cell + 1;
+        const int cellsY = (height + cell - 1) / cell + 1;
+        std::vector<std::vector<unsigned>> grid(size_t(cellsX) * cellsY);
+        std::vector<unsigned> wave(squares.size());
+        std::vector<std::vector<unsigned>> waves;
+
+        for (unsigned i = 0; i < squares.size(); ++i) {
+            const Square& s = squares[i];
+            int cx0 = std::max(s.x0 - 1, 0) / cell, cx1 = std::min(s.x0 + s.size, width - 1) / cell;
+            int cy0 = std::max(s.y0 - 1, 0) / cell, cy1 = std::min(s.y0 + s.size, height - 1) / cell;
+            unsigned level = 0;
+            for (int cy = cy0; cy <= cy1; ++cy) {
+                for (int cx = cx0; cx <= cx1; ++cx) {
+                    for (unsigned j : grid[size_t(cy) * cellsX + cx]) {
+                        const Square& o = squares[j];
+                        bool overlap = s.x0 - 1 < o.x0 + o.size && o.x0 < s.x0 + s.size + 1
+                            && s.y0 - 1 < o.y0 + o.size && o.y0 < s.y0 + s.size + 1;
+                        if (overlap) {
+                            level = std::max(level, wave[j] + 1);
+                        }
+                    }
+                }
+            }
+            // Квадрат регистрируется в ячейках своего прямоугольника
+            for (int cy = s.y0 / cell; cy <= (s.y0 + s.size - 1) / cell; ++cy) {
+                for (int cx = s.x0 / cell; cx <= (s.x0 + s.size - 1) / cell; ++cx) {
+                    grid[size_t(cy) * cellsX + cx].push_back(i);
+                }
+            }
+            wave[i] = level;
+            if (level >= waves.size()) {
+                waves.resize(level + 1);
+            }
+            waves[level].push_back(i);
+        }
+        return waves;
+    }
 
-        for (int y = 0; y < height; ++y) {
-            inFile.read(reinterpret_cast<char*>(pixels[y].data()), width * sizeof(Pixel));
-            int padding = (4 - (width * sizeof(Pixel)) % 4) % 4;
-            inFile.ignore(padding);
+    // Все средние считаются по исходным значениям и только потом записываются
+    void BlurSquareBuffered(const Square& square, std::vector<Pixel>& scratch) {
+        Pixel* out = scratch.data();
+        for (int y = square.y0; y < square.y0 + square.size; ++y) {
+            for (int x = square.x0; x < square.x0 + square.size; ++x) {
+                *out++ = CalculateAverageColor(x, y);
+            }
+        }
+        const Pixel* in = scratch.data();
+        for (int y = square.y0; y < square.y0 + square.size; ++y) {
+            for (int x = square.x0; x < square.x0 + square.size; ++x) {
+                pixels.Set(x, y, *in++);
+            }
         }
     }
 
@@ -108,30 +198,34 @@ private:
     }
 
     void ApplyBlurToSquare(unsigned startX, unsigned startY, unsigned squareSize) {
-        for (unsigned y = startY; y < startY + squareSize && y < height; ++y) {
-            for (unsigned x = startX; x < startX + squareSize && x < width; ++x) {
-                pixels[y][x] = CalculateAverageColor(x, y);
+        for (unsigned y = startY; y < startY + squareSize && y < unsigned(height); ++y) {
+            for (unsigned x = startX; x < startX + squareSize && x < unsigned(width); ++x) {
+                pixels.Set(x, y, CalculateAverageColor(x, y));
             }
         }
     }
 
+    // Соседи читаются по указателю строки и шагам текущего представления
     Pixel CalculateAverageColor(unsigned x, unsigned y) const {
-        int red = 0, green = 0, blue = 0, count = 0;
-        for (int dy = -1; dy <= 1; ++dy) {
-            for (int dx = -1; dx <= 1; ++dx) {
-                unsigned nx = x + dx, ny = y + dy;
-                if (nx < width && ny < height) {
-                    red += pixels[ny][nx].red;
-                    green += pixels[ny][nx].green;
-                    blue += pixels[ny][nx].blue;
-                    ++count;
+        const size_t pixelStep = pixels.PixelStep();
+        const size_t channelStep = pixels.ChannelStep();
+        int y0 = std::max(int(y) - 1, 0), y1 = std::min(int(y) + 1, height - 1);
+        int x0 = std::max(int(x) - 1, 0), x1 = std::min(int(x) + 1, width - 1);
+        int sums[3] = {};
+        for (int ny = y0; ny <= y1; ++ny) {
+            const uint8_t* row = pixels.Row(ny);
+            for (int c = 0; c < 3; ++c) {
+                const uint8_t* p = row + c * channelStep;
+                for (int nx = x0; nx <= x1; ++nx) {
+                    sums[c] += p[nx * pixelStep];
                 }
             }
         }
+        int count = (y1 - y0 + 1) * (x1 - x0 + 1);
         return Pixel{
-            static_cast<uint8_t>(blue / count),
-            static_cast<uint8_t>(green / count),
-            static_cast<uint8_t>(red / count)
+            static_cast<uint8_t>(sums[0] / count),
+            static_cast<uint8_t>(sums[1] / count),
+            static_cast<uint8_t>(sums[2] / count)
         };
     }
 };
\ No newline at end of file
@@ -0,0 +1,195 @@
+﻿#pragma once
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FileIO.h"
+#include "MappedBMP.h"
+#include "StripStream.h"
+
+// Очередь ограниченной ёмкости между стадиями конвейера
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(std::max<size_t>(capacity, 1)) {}
+
+    // false, если очередь закрыли (в том числе пока ждали места) - элемент не принят
+    bool Push(T item) {
+        std::unique_lock<std::mutex> lock(mtx);
+        notFull.wait(lock, [this] { return closed || items.size() < capacity; });
+        if (closed) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // false, когда очередь закрыта и пуста
+    bool Pop(T& item) {
+        std::unique_lock<std::mutex> lock(mtx);
+        notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    void Close() {
+        std::lock_guard<std::mutex> lock(mtx);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+private:
+    size_t capacity;
+    std::mutex mtx;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    std::deque<T> items;
+    bool closed = false;
+};
+
+struct BatchImage {
+    std::string inputPath;
+    std::string outputPath;
+    BMPLayout layout;
+    std::vector<uint8_t> prefix;
+    std::vector<uint8_t> src;
+    std::vector<uint8_t> dst;
+    std::chrono::steady_clock::time_point started;
+    std::string error;
+};
+
+struct BatchStats {
+    int images = 0;
+    int failed = 0;
+    double seconds = 0;
+};
+
+// Каталог (все *.bmp по имени) или текстовый файл со списком путей, по одному в строке
+inline std::vector<std::string> ListBatchInputs(const std::string& source) {
+    std::vector<std::string> inputs;
+    if (std::filesystem::is_directory(source)) {
+        for (const auto& entry : std::filesystem::directory_iterator(source)) {
+            std::string ext = entry.path().extension().string();
+            std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+            if (entry.is_regular_file() && ext == ".bmp") {
+                inputs.push_back(entry.path().string());
+            }
+        }
+        std::sort(inputs.begin(), inputs.end());
+    } else {
+        std::ifstream list(source);
+        if (!list) {
+            throw std::runtime_error("Could not open batch list: " + source);
+        }
+        std::string line;
+        while (std::getline(list, line)) {
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (!line.empty()) {
+                inputs.push_back(line);
+            }
+        }
+    }
+    return inputs;
+}
+
+// Конвейер загрузка -> размытие -> сохранение: загрузка и сохранение идут в своих потоках,
+// размытие blur(src, dst) - в вызывающем потоке (на пуле). Между стадиями не больше depth
+// изображений, так что память ограничена, а чтение, счёт и запись соседних изображений перекрываются.
+template <typename BlurFn>
+inline BatchStats RunBatch(const std::vector<std::string>& inputs, const std::string& outputDir, size_t depth, BlurFn blur) {
+    using Job = std::unique_ptr<BatchImage>;
+    std::filesystem::create_directories(outputDir);
+    BoundedQueue<Job> loaded(depth);
+    BoundedQueue<Job> blurred(depth);
+    BatchStats stats;
+    auto batchStart = std::chrono::steady_clock::now();
+
+    std::jthread loader([&] {
+        for (const std::string& path : inputs) {
+            Job job = std::make_unique<BatchImage>();
+            job->started = std::chrono::steady_clock::now();
+            job->inputPath = path;
+            job->outputPath = (std::filesystem::path(outputDir) / std::filesystem::path(path).filename()).string();
+            try {
+                PositionalFile in = PositionalFile::OpenRead(path);
+                job->layout = ReadBMPPrefix(in, job->prefix);
+                job->src.resize(job->layout.DataSize());
+                in.ReadAt(job->src.data(), job->src.size(), job->layout.dataOffset);
+                job->dst.resize(job->src.size());
+            } catch (const std::exception& e) {
+                job->error = e.what();
+            }
+            if (!loaded.Push(std::move(job))) {
+                break;
+            }
+        }
+        loaded.Close();
+    });
+
+    std::jthread saver([&] {
+        Job job;
+        while (blurred.Pop(job)) {
+            if (job->error.empty()) {
+                try {
+                    PositionalFile out = PositionalFile::Create(job->outputPath, job->prefix.size() + job->dst.size());
+                    out.WriteAt(job->prefix.data(), job->prefix.size(), 0);
+                    out.WriteAt(job->dst.data(), job->dst.size(), job->layout.dataOffset);
+                } catch (const std::exception& e) {
+                    job->error = e.what();
+                }
+            }
+
+            ++stats.images;
+            if (!job->error.empty()) {
+                ++stats.failed;
+                std::cerr << job->inputPath << ": " << job->error << std::endl;
+                continue;
+            }
+            auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - job->started);
+            std::cout << job->inputPath << ": " << job->layout.width << "x" << job->layout.height
+                << ", latency " << latency.count() / 1000.0 << " ms" << std::endl;
+        }
+    });
+
+    // Если blur бросит исключение, обе очереди закрываются до join потоков в деструкторах
+    // jthread: загрузчик перестаёт ждать места, сохранитель дописывает готовое и выходит.
+    struct CloseQueues {
+        BoundedQueue<Job>& loaded;
+        BoundedQueue<Job>& blurred;
+        ~CloseQueues() {
+            loaded.Close();
+            blurred.Close();
+        }
+    } closeQueues{ loaded, blurred };
+
+    Job job;
+    while (loaded.Pop(job)) {
+        if (job->error.empty()) {
+            blur(job->layout.BufferView(job->src.data(), job->layout.height),
+                job->layout.BufferView(job->dst.data(), job->layout.height));
+        }
+        blurred.Push(std::move(job));
+    }
+    blurred.Close();
+    saver.join();
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count();
+    return stats;
+}
@@ -5,17 +5,31 @@
 #include <stdexcept>
 #include <string>
 #include <optional>
+#include <span>
+#include <cstdint>
+#include <cstring>
+#include "AlignedBuffer.h"
+#include "MappedBMP.h"
+
+// Bounds checks in at()/row() are a debug-only layer; define BMP_CHECKED to keep them in release
+#if !defined(NDEBUG) && !defined(BMP_CHECKED)
+#define BMP_CHECKED
+#endif
 
 namespace bmp {
 
+    // Packed 3-byte pixel in BMP memory order (blue, green, red)
     struct Pixel {
-        int r; // Red component
-        int g; // Green component
-        int b; // Blue component
+        uint8_t b; // Blue component
+        uint8_t g; // Green component
+        uint8_t r; // Red component
+
+        Pixel(uint8_t red = 0, uint8_t green = 0, uint8_t blue = 0)
+            : b(blue), g(green), r(red) {}
 
-        Pixel(int red = 0, int green = 0, int blue = 0)
-            : r(red), g(green), b(blue) {}
+        bool operator==(const Pixel&) const = default;
     };
+    static_assert(sizeof(Pixel) == 3, "Pixel must be packed to 3 bytes");
 
     class Exception : public std::runtime_error {
     public:
@@ -23,27 +37,153 @@ namespace bmp {
             : std::runtime_error(message) {}
     };
 
+    // 24-bit image in one 64-byte aligned buffer, rows top to bottom without padding
     class Bitmap {
     public:
+        static constexpr size_t Alignment = kBufferAlignment;
+
         Bitmap(const std::string& filename);
+        Bitmap(unsigned width, unsigned height);
         ~Bitmap();
 
+        Bitmap(Bitmap&&) noexcept = default;
+        Bitmap& operator=(Bitmap&&) noexcept = default;
+
         unsigned width() const;
         unsigned height() const;
 
+        // Checked access
         std::optional<Pixel> get(unsigned x, unsigned y) const;
         void set(unsigned x, unsigned y, const Pixel& pixel);
         void save(const std::string& filename) const;
 
+        // Fast path: checked only in debug builds
+        Pixel& at(unsigned x, unsigned y);
+        const Pixel& at(unsigned x, unsigned y) const;
+        std::span<Pixel> row(unsigned y);
+        std::span<const Pixel> row(unsigned y) const;
+
+        Pixel* data();
+        const Pixel* data() const;
+        // Bytes between rows; rows are contiguous, so this is width() * 3
+        ptrdiff_t stride() const;
+        // Raw BGR24 window for the blur kernels
+        ImageView view();
+
     private:
-        unsigned _width;
-        unsigned _height;
-        std::vector<Pixel> _pixels;
+        unsigned _width = 0;
+        unsigned _height = 0;
+        AlignedBytes _pixels;
 
         void loadFromFile(const std::string& filename);
         void allocateMemory();
+        void checkBounds(unsigned x, unsigned y) const;
     };
 
+    inline Bitmap::Bitmap(const std::string& filename) {
+        loadFromFile(filename);
+    }
+
+    inline Bitmap::Bitmap(unsigned width, unsigned height)
+        : _width(width), _height(height)
+    {
+        allocateMemory();
+    }
+
+    inline Bitmap::~Bitmap() = default;
+
+    inline unsigned Bitmap::width() const { return _width; }
+    inline unsigned Bitmap::height() const { return _height; }
+
+    inline std::optional<Pixel> Bitmap::get(unsigned x, unsigned y) const {
+        if (x >= _width || y >= _height) {
+            return std::nullopt;
+        }
+        return data()[size_t(y) * _width + x];
+    }
+
+    inline void Bitmap::set(unsigned x, unsigned y, const Pixel& pixel) {
+        if (x >= _width || y >= _height) {
+            throw Exception("Pixel out of bounds");
+        }
+        data()[size_t(y) * _width + x] = pixel;
+    }
+
+    inline Pixel& Bitmap::at(unsigned x, unsigned y) {
+#ifdef BMP_CHECKED
+        checkBounds(x, y);
+#endif
+        return data()[size_t(y) * _width + x];
+    }
+
+    inline const Pixel& Bitmap::at(unsigned x, unsigned y) const {
+#ifdef BMP_CHECKED
+        checkBounds(x, y);
+#endif
+        return data()[size_t(y) * _width + x];
+    }
+
+    inline std::span<Pixel> Bitmap::row(unsigned y) {
+#ifdef BMP_CHECKED
+        checkBounds(0, y);
+#endif
+        return { data() + size_t(y) * _width, _width };
+    }
+
+    inline std::span<const Pixel> Bitmap::row(unsigned y) const {
+#ifdef BMP_CHECKED
+        checkBounds(0, y);
+#endif
+        return { data() + size_t(y) * _width, _width };
+    }
+
+    inline Pixel* Bitmap::data() { return reinterpret_cast<Pixel*>(_pixels.get()); }
+    inline const Pixel* Bitmap::data() const { return reinterpret_cast<const Pixel*>(_pixels.get()); }
+    inline ptrdiff_t Bitmap::stride() const { return ptrdiff_t(_width) * sizeof(Pixel); }
+
+    inline ImageView Bitmap::view() {
+        return ImageView{ _pixels.get(), int(_width), int(_height), stride() };
+    }
+
+    inline void Bitmap::save(const std::string& filename) const {
+        try {
+            MappedBMP out = MappedBMP::Create(filename, int(_width), int(_height));
+            ImageView view = out.Pixels();
+            for (unsigned y = 0; y < _height; ++y) {
+                std::memcpy(view.Row(int(y)), row(y).data(), size_t(_width) * sizeof(Pixel));
+            }
+        } catch (const std::runtime_error& e) {
+            throw Exception(e.what());
+        }
+    }
+
+    inline void Bitmap::loadFromFile(const std::string& filename) {
+        try {
+            MappedBMP in = MappedBMP::Open(filename);
+            _width = unsigned(in.Width());
+            _height = unsigned(in.Height());
+            allocateMemory();
+            ImageView view = in.Pixels();
+            for (unsigned y = 0; y < _height; ++y) {
+                std::memcpy(row(y).data(), view.Row(int(y)), size_t(_width) * sizeof(Pixel));
+            }
+        } catch (const std::runtime_error& e) {
+            throw Exception(e.what());
+        }
+    }
+
+    inline void Bitmap::allocateMemory() {
+        size_t bytes = size_t(_width) * _height * sizeof(Pixel);
+        _pixels = AllocateAligned(bytes);
+        std::memset(_pixels.get(), 0, bytes);
+    }
+
+    inline void Bitmap::checkBounds(unsigned x, unsigned y) const {
+        if (x >= _width || y >= _height) {
+            throw Exception("Pixel (" + std::to_string(x) + ", " + std::to_string(y) + ") out of bounds");
+        }
+    }
+
 } // namespace bmp
 
-#endif // BITMAPPLUSPLUS_H
\ No newline at end of file
+#endif // BITMAPPLUSPLUS_H
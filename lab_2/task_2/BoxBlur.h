@@ -0,0 +1,169 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+// Деление на константу через умножение: floor(n / d) для n <= 255 * d
+struct Reciprocal {
+    static constexpr unsigned kShift = 55;
+    uint64_t mul = 1;
+
+    Reciprocal() = default;
+    explicit Reciprocal(uint32_t d) : mul(((uint64_t(1) << kShift) + d - 1) / d) {}
+
+    uint32_t Divide(uint64_t n) const {
+        return static_cast<uint32_t>((n * mul) >> kShift);
+    }
+};
+
+// Скользящее окно по одной строке: суммы каналов для x из [x0, x1),
+// окно [x - radius, x + radius] обрезается по краям изображения.
+// Radius > 0 задаёт радиус на этапе компиляции, Radius = 0 - радиус radiusArg.
+template <int Radius, int Channels>
+inline void BoxSumRowT(const uint8_t* row, uint32_t* sums, int width, int x0, int x1, int radiusArg) {
+    const int radius = Radius > 0 ? Radius : radiusArg;
+    uint32_t s[Channels] = {};
+    for (int nx = std::max(x0 - radius, 0); nx <= std::min(x0 + radius, width - 1); ++nx) {
+        for (int c = 0; c < Channels; ++c) {
+            s[c] += row[nx * Channels + c];
+        }
+    }
+
+    auto store = [&](int x) {
+        uint32_t* out = sums + (x - x0) * Channels;
+        for (int c = 0; c < Channels; ++c) {
+            out[c] = s[c];
+        }
+    };
+    auto step = [&](int x) {
+        int add = x + radius + 1, sub = x - radius;
+        for (int c = 0; c < Channels; ++c) {
+            if (add < width) {
+                s[c] += row[add * Channels + c];
+            }
+            if (sub >= 0) {
+                s[c] -= row[sub * Channels + c];
+            }
+        }
+    };
+
+    // Внутренняя часть: оба края окна внутри строки, без проверок границ
+    int innerBegin = std::clamp(radius, x0, x1);
+    int innerEnd = std::clamp(width - radius - 1, innerBegin, x1);
+    int x = x0;
+    for (; x < innerBegin; ++x) {
+        store(x);
+        step(x);
+    }
+    for (; x < innerEnd; ++x) {
+        store(x);
+        const uint8_t* add = row + (x + radius + 1) * Channels;
+        const uint8_t* sub = row + (x - radius) * Channels;
+        for (int c = 0; c < Channels; ++c) {
+            s[c] += add[c] - sub[c];
+        }
+    }
+    for (; x < x1; ++x) {
+        store(x);
+        step(x);
+    }
+}
+
+// Размытие средним в окне (2 * radius + 1)^2 для прямоугольника [x0, x1) x [y0, y1).
+// Сначала горизонтальные суммы строк с ореолом, затем скользящая сумма по столбцам,
+// стоимость на пиксель не зависит от радиуса. Для radius = 1 результат побайтно
+// совпадает с прежним проходом по 9 соседям.
+template <int Radius, int Channels>
+inline void BoxBlurRectT(const uint8_t* src, uint8_t* dst, int width, int height, ptrdiff_t stride,
+    int x0, int y0, int x1, int y1, int radiusArg = Radius) {
+    const int radius = Radius > 0 ? Radius : radiusArg;
+    x1 = std::min(x1, width);
+    y1 = std::min(y1, height);
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    const int rowLen = (x1 - x0) * Channels;
+    int haloY0 = std::max(y0 - radius, 0);
+    int haloY1 = std::min(y1 + radius, height);
+
+    thread_local std::vector<uint32_t> rowSums;
+    thread_local std::vector<uint32_t> colSums;
+    rowSums.resize(size_t(haloY1 - haloY0) * rowLen);
+    colSums.assign(size_t(rowLen), 0);
+
+    for (int y = haloY0; y < haloY1; ++y) {
+        BoxSumRowT<Radius, Channels>(src + y * stride, rowSums.data() + size_t(y - haloY0) * rowLen, width, x0, x1, radius);
+    }
+    auto sumsAt = [&](int y) { return rowSums.data() + size_t(y - haloY0) * rowLen; };
+
+    for (int y = std::max(y0 - radius, 0); y <= std::min(y0 + radius, height - 1); ++y) {
+        const uint32_t* r = sumsAt(y);
+        for (int i = 0; i < rowLen; ++i) {
+            colSums[i] += r[i];
+        }
+    }
+
+    int innerX0 = std::clamp(radius, x0, x1);
+    int innerX1 = std::clamp(width - radius, innerX0, x1);
+    for (int y = y0; y < y1; ++y) {
+        int countY = std::min(y + radius, height - 1) - std::max(y - radius, 0) + 1;
+        uint8_t* out = dst + y * stride;
+
+        // Края по x: окно обрезано, делим честно
+        auto edge = [&](int x) {
+            int count = (std::min(x + radius, width - 1) - std::max(x - radius, 0) + 1) * countY;
+            const uint32_t* s = colSums.data() + (x - x0) * Channels;
+            for (int c = 0; c < Channels; ++c) {
+                out[x * Channels + c] = static_cast<uint8_t>(s[c] / count);
+            }
+        };
+        for (int x = x0; x < innerX0; ++x) {
+            edge(x);
+        }
+        for (int x = innerX1; x < x1; ++x) {
+            edge(x);
+        }
+
+        // Внутренняя часть: делитель постоянен в строке
+        Reciprocal inner(uint32_t(2 * radius + 1) * countY);
+        const uint32_t* s = colSums.data() + (innerX0 - x0) * Channels;
+        uint8_t* o = out + innerX0 * Channels;
+        for (int i = 0; i < (innerX1 - innerX0) * Channels; ++i) {
+            o[i] = static_cast<uint8_t>(inner.Divide(s[i]));
+        }
+
+        int add = y + radius + 1, sub = y - radius;
+        if (add < haloY1) {
+            const uint32_t* r = sumsAt(add);
+            for (int i = 0; i < rowLen; ++i) {
+                colSums[i] += r[i];
+            }
+        }
+        if (sub >= 0) {
+            const uint32_t* r = sumsAt(sub);
+            for (int i = 0; i < rowLen; ++i) {
+                colSums[i] -= r[i];
+            }
+        }
+    }
+}
+
+// Выбор специализации по радиусу; остальные радиусы - общий вариант
+template <int Channels>
+inline void BoxBlurRectN(const uint8_t* src, uint8_t* dst, int width, int height, ptrdiff_t stride,
+    int x0, int y0, int x1, int y1, int radius) {
+    switch (radius) {
+    case 1: BoxBlurRectT<1, Channels>(src, dst, width, height, stride, x0, y0, x1, y1); break;
+    case 2: BoxBlurRectT<2, Channels>(src, dst, width, height, stride, x0, y0, x1, y1); break;
+    case 3: BoxBlurRectT<3, Channels>(src, dst, width, height, stride, x0, y0, x1, y1); break;
+    case 5: BoxBlurRectT<5, Channels>(src, dst, width, height, stride, x0, y0, x1, y1); break;
+    default: BoxBlurRectT<0, Channels>(src, dst, width, height, stride, x0, y0, x1, y1, radius); break;
+    }
+}
+
+inline void BoxBlurRect(const uint8_t* src, uint8_t* dst, int width, int height, ptrdiff_t stride,
+    int x0, int y0, int x1, int y1, int radius) {
+    BoxBlurRectN<3>(src, dst, width, height, stride, x0, y0, x1, y1, radius);
+}
@@ -0,0 +1,264 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "ImageView.h"
+
+// Произвольное (не обязательно разделимое) ядро свёртки kw x kh, центр (kw / 2, kh / 2):
+// out(x, y) = sum K[j][i] * in(x + i - cx, y + j - cy), за краем изображения - крайние пиксели
+struct ConvKernel {
+    int width = 0;
+    int height = 0;
+    std::vector<float> weights;   // по строкам, верхняя строка первая
+
+    int CenterX() const { return width / 2; }
+    int CenterY() const { return height / 2; }
+    int Halo() const { return std::max({ CenterX(), width - 1 - CenterX(), CenterY(), height - 1 - CenterY() }); }
+};
+
+// Текстовый файл: "w h", затем w * h весов. Ядро с положительной суммой нормируется к 1.
+inline ConvKernel LoadConvKernel(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Could not open kernel file: " + path);
+    }
+    ConvKernel kernel;
+    if (!(in >> kernel.width >> kernel.height) || kernel.width <= 0 || kernel.height <= 0) {
+        throw std::runtime_error("Invalid kernel size in " + path);
+    }
+    kernel.weights.resize(size_t(kernel.width) * kernel.height);
+    double sum = 0;
+    for (float& w : kernel.weights) {
+        if (!(in >> w)) {
+            throw std::runtime_error("Not enough kernel weights in " + path);
+        }
+        sum += w;
+    }
+    if (sum > 0) {
+        for (float& w : kernel.weights) {
+            w = static_cast<float>(w / sum);
+        }
+    }
+    return kernel;
+}
+
+// Прямая свёртка прямоугольника [x0, x1) x [y0, y1); O(kw * kh) на пиксель
+inline void ConvolveDirectRect(const uint8_t* src, uint8_t* dst, int width, int height, ptrdiff_t stride,
+    int x0, int y0, int x1, int y1, const ConvKernel& kernel) {
+    x1 = std::min(x1, width);
+    y1 = std::min(y1, height);
+    const int cx = kernel.CenterX(), cy = kernel.CenterY();
+    for (int y = y0; y < y1; ++y) {
+        uint8_t* out = dst + y * stride;
+        for (int x = x0; x < x1; ++x) {
+            float sum[3] = {};
+            for (int j = 0; j < kernel.height; ++j) {
+                const uint8_t* row = src + std::clamp(y + j - cy, 0, height - 1) * stride;
+                const float* k = kernel.weights.data() + size_t(j) * kernel.width;
+                for (int i = 0; i < kernel.width; ++i) {
+                    const uint8_t* p = row + std::clamp(x + i - cx, 0, width - 1) * 3;
+                    sum[0] += k[i] * p[0];
+                    sum[1] += k[i] * p[1];
+                    sum[2] += k[i] * p[2];
+                }
+            }
+            for (int c = 0; c < 3; ++c) {
+                out[x * 3 + c] = static_cast<uint8_t>(std::clamp(std::lround(sum[c]), 0L, 255L));
+            }
+        }
+    }
+}
+
+// Комплексное БПФ длины 2^k (итеративное, по основанию 2) с готовыми поворотными множителями
+class Fft {
+public:
+    using Complex = std::complex<float>;
+
+    explicit Fft(int size = 0) : size(size), twiddles(size / 2), reversed(size) {
+        int bits = 0;
+        while ((1 << bits) < size) {
+            ++bits;
+        }
+        for (int i = 0; i < size; ++i) {
+            int r = 0;
+            for (int b = 0; b < bits; ++b) {
+                r |= ((i >> b) & 1) << (bits - 1 - b);
+            }
+            reversed[i] = r;
+        }
+        const double pi = std::acos(-1.0);
+        for (int i = 0; i < size / 2; ++i) {
+            twiddles[i] = Complex(float(std::cos(2 * pi * i / size)), float(-std::sin(2 * pi * i / size)));
+        }
+    }
+
+    int Size() const { return size; }
+
+    // На месте, данные с шагом step; inverse - без деления на size
+    void Transform(Complex* data, ptrdiff_t step, bool inverse) const {
+        for (int i = 0; i < size; ++i) {
+            if (i < reversed[i]) {
+                std::swap(data[i * step], data[reversed[i] * step]);
+            }
+        }
+        for (int len = 2; len <= size; len <<= 1) {
+            int half = len / 2, twStep = size / len;
+            for (int i = 0; i < size; i += len) {
+                for (int j = 0; j < half; ++j) {
+                    Complex w = twiddles[j * twStep];
+                    if (inverse) {
+                        w = std::conj(w);
+                    }
+                    Complex& a = data[(i + j) * step];
+                    Complex& b = data[(i + j + half) * step];
+                    Complex t = b * w;
+                    b = a - t;
+                    a += t;
+                }
+            }
+        }
+    }
+
+    // Двумерное size x size, строки подряд
+    void Transform2D(Complex* data, bool inverse) const {
+        for (int y = 0; y < size; ++y) {
+            Transform(data + size_t(y) * size, 1, inverse);
+        }
+        for (int x = 0; x < size; ++x) {
+            Transform(data + x, size, inverse);
+        }
+    }
+
+private:
+    int size;
+    std::vector<Complex> twiddles;
+    std::vector<int> reversed;
+};
+
+// Свёртка перекрытием с сохранением (overlap-save): блок N x N исходного изображения
+// (со сдвигом на центр ядра, за краем - крайние пиксели) переводится в спектр, умножается
+// на заранее посчитанный спектр отражённого ядра и переводится обратно; верные (без
+// заворота) - последние N - kw + 1 столбцов и N - kh + 1 строк. Каналы идут парами
+// в одном комплексном БПФ (B + iG, R): свёртка с вещественным ядром линейна, поэтому
+// вещественная и мнимая части не смешиваются - это и есть вещественное БПФ вдвое дешевле.
+class FftConvolver {
+public:
+    using Complex = Fft::Complex;
+
+    FftConvolver() = default;
+    FftConvolver(const ConvKernel& kernel, int blockSize)
+        : kernel(kernel)
+    {
+        // Блок должен вмещать ядро, иначе верной части нет, а спектр ядра выходит за блок
+        if (blockSize <= std::max(kernel.width, kernel.height) || (blockSize & (blockSize - 1)) != 0) {
+            throw std::runtime_error("FFT block size must be a power of two larger than the kernel.");
+        }
+        fft = Fft(blockSize);
+        spectrum.assign(size_t(blockSize) * blockSize, Complex());
+        const int n = blockSize;
+        for (int j = 0; j < kernel.height; ++j) {
+            for (int i = 0; i < kernel.width; ++i) {
+                spectrum[size_t(kernel.height - 1 - j) * n + (kernel.width - 1 - i)] = kernel.weights[size_t(j) * kernel.width + i];
+            }
+        }
+        fft.Transform2D(spectrum.data(), false);
+        // Деление обратного преобразования на N^2 - сразу в спектре ядра
+        for (Complex& c : spectrum) {
+            c /= float(n) * float(n);
+        }
+    }
+
+    int BlockSize() const { return fft.Size(); }
+    // Размер верной части блока - шаг плиток
+    int ValidWidth() const { return fft.Size() - kernel.width + 1; }
+    int ValidHeight() const { return fft.Size() - kernel.height + 1; }
+
+    // Наибольший блок: 4096^2 комплексных чисел - 128 МБ на буфер, а их у потока два
+    static constexpr int kMaxBlockSize = 4096;
+
+    // Наименьшая по оценке стоимость на пиксель среди блоков 2^k, больших ядра (оценка сама
+    // учитывает, сколько верных пикселей остаётся в блоке); 0 - ядро не помещается даже в
+    // kMaxBlockSize, тогда только прямая свёртка
+    static int ChooseBlockSize(const ConvKernel& kernel, double* costPerPixel = nullptr) {
+        int best = 0;
+        double bestCost = 0;
+        for (int n = 32; n <= kMaxBlockSize; n *= 2) {
+            if (n <= std::max(kernel.width, kernel.height)) {
+                continue;
+            }
+            double valid = double(n - kernel.width + 1) * double(n - kernel.height + 1);
+            // 2 пары каналов x (прямое + обратное) x 2D БПФ ~ 5 N^2 log2 N^2 операций, плюс умножение
+            double cost = 2 * (2 * 5.0 * n * n * std::log2(double(n) * n) + 6.0 * n * n) / valid;
+            if (best == 0 || cost < bestCost) {
+                best = n;
+                bestCost = cost;
+            }
+        }
+        if (costPerPixel) {
+            *costPerPixel = bestCost;
+        }
+        return best;
+    }
+
+    // Выход в прямоугольнике [x0, x1) x [y0, y1), не больше ValidWidth x ValidHeight
+    void ConvolveBlock(const ImageView& src, const ImageView& dst, int x0, int y0, int x1, int y1) const {
+        const int n = fft.Size();
+        const int bx = x0 - kernel.CenterX(), by = y0 - kernel.CenterY();
+        const int offX = kernel.width - 1, offY = kernel.height - 1;
+        thread_local std::vector<Complex> pairs[2];
+        for (auto& p : pairs) {
+            p.resize(size_t(n) * n);
+        }
+
+        for (int v = 0; v < n; ++v) {
+            const uint8_t* row = src.Row(std::clamp(by + v, 0, src.height - 1));
+            Complex* bg = pairs[0].data() + size_t(v) * n;
+            Complex* r = pairs[1].data() + size_t(v) * n;
+            for (int u = 0; u < n; ++u) {
+                const uint8_t* p = row + std::clamp(bx + u, 0, src.width - 1) * 3;
+                bg[u] = Complex(p[0], p[1]);
+                r[u] = Complex(p[2], 0);
+            }
+        }
+
+        for (auto& p : pairs) {
+            fft.Transform2D(p.data(), false);
+            for (size_t i = 0; i < p.size(); ++i) {
+                p[i] *= spectrum[i];
+            }
+            fft.Transform2D(p.data(), true);
+        }
+
+        auto toByte = [](float v) { return static_cast<uint8_t>(std::clamp(std::lround(v), 0L, 255L)); };
+        for (int y = y0; y < y1; ++y) {
+            uint8_t* out = dst.Row(y);
+            const Complex* bg = pairs[0].data() + size_t(y - y0 + offY) * n + offX;
+            const Complex* r = pairs[1].data() + size_t(y - y0 + offY) * n + offX;
+            for (int x = x0; x < x1; ++x) {
+                out[x * 3] = toByte(bg[x - x0].real());
+                out[x * 3 + 1] = toByte(bg[x - x0].imag());
+                out[x * 3 + 2] = toByte(r[x - x0].real());
+            }
+        }
+    }
+
+private:
+    ConvKernel kernel;
+    Fft fft;
+    std::vector<Complex> spectrum;
+};
+
+// Прямая свёртка дешевле, если 3 канала x kw x kh операций меньше оценки БПФ на пиксель
+inline bool PreferFftConvolution(const ConvKernel& kernel) {
+    double fftCost = 0;
+    if (FftConvolver::ChooseBlockSize(kernel, &fftCost) == 0) {
+        return false;
+    }
+    return 3.0 * kernel.width * kernel.height > fftCost;
+}
@@ -0,0 +1,168 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Файл с чтением и записью по смещению (pread/pwrite), без общего указателя позиции:
+// несколько потоков могут читать и писать разные участки одновременно.
+class PositionalFile {
+public:
+    PositionalFile() = default;
+    PositionalFile(const PositionalFile&) = delete;
+    PositionalFile& operator=(const PositionalFile&) = delete;
+    PositionalFile(PositionalFile&& other) noexcept { std::swap(handle, other.handle); }
+
+    PositionalFile& operator=(PositionalFile&& other) noexcept {
+        std::swap(handle, other.handle);
+        return *this;
+    }
+
+    ~PositionalFile() { Close(); }
+
+    static PositionalFile OpenRead(const std::string& path) {
+        PositionalFile file;
+#ifdef _WIN32
+        file.handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+        file.handle = open(path.c_str(), O_RDONLY);
+#endif
+        if (!file.IsOpen()) {
+            throw std::runtime_error("Could not open file for reading: " + path);
+        }
+        return file;
+    }
+
+    // Существующий файл для правки на месте
+    static PositionalFile OpenReadWrite(const std::string& path) {
+        PositionalFile file;
+#ifdef _WIN32
+        file.handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+        file.handle = open(path.c_str(), O_RDWR);
+#endif
+        if (!file.IsOpen()) {
+            throw std::runtime_error("Could not open file for writing: " + path);
+        }
+        return file;
+    }
+
+    static PositionalFile Create(const std::string& path, uint64_t size) {
+        PositionalFile file;
+#ifdef _WIN32
+        file.handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER end;
+        end.QuadPart = static_cast<LONGLONG>(size);
+        bool resized = file.IsOpen() && SetFilePointerEx(file.handle, end, nullptr, FILE_BEGIN) && SetEndOfFile(file.handle);
+#else
+        file.handle = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        bool resized = file.IsOpen() && ftruncate(file.handle, static_cast<off_t>(size)) == 0;
+#endif
+        if (!resized) {
+            throw std::runtime_error("Could not create file: " + path);
+        }
+        return file;
+    }
+
+    bool IsOpen() const {
+#ifdef _WIN32
+        return handle != INVALID_HANDLE_VALUE;
+#else
+        return handle >= 0;
+#endif
+    }
+
+#ifdef _WIN32
+    HANDLE NativeHandle() const { return handle; }
+#else
+    int NativeHandle() const { return handle; }
+#endif
+
+    uint64_t Size() const {
+#ifdef _WIN32
+        LARGE_INTEGER size;
+        GetFileSizeEx(handle, &size);
+        return static_cast<uint64_t>(size.QuadPart);
+#else
+        struct stat st;
+        fstat(handle, &st);
+        return static_cast<uint64_t>(st.st_size);
+#endif
+    }
+
+    void ReadAt(void* buffer, uint64_t size, uint64_t offset) const {
+        uint8_t* out = static_cast<uint8_t*>(buffer);
+        while (size > 0) {
+            uint64_t done = Transfer(out, size, offset, false);
+            if (done == 0) {
+                throw std::runtime_error("Unexpected end of file.");
+            }
+            out += done;
+            size -= done;
+            offset += done;
+        }
+    }
+
+    void WriteAt(const void* buffer, uint64_t size, uint64_t offset) const {
+        uint8_t* in = const_cast<uint8_t*>(static_cast<const uint8_t*>(buffer));
+        while (size > 0) {
+            uint64_t done = Transfer(in, size, offset, true);
+            if (done == 0) {
+                throw std::runtime_error("Could not write file.");
+            }
+            in += done;
+            size -= done;
+            offset += done;
+        }
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE handle = INVALID_HANDLE_VALUE;
+
+    uint64_t Transfer(uint8_t* buffer, uint64_t size, uint64_t offset, bool write) const {
+        OVERLAPPED overlapped{};
+        overlapped.Offset = DWORD(offset);
+        overlapped.OffsetHigh = DWORD(offset >> 32);
+        DWORD chunk = DWORD(std::min<uint64_t>(size, 1u << 30));
+        DWORD done = 0;
+        BOOL ok = write ? WriteFile(handle, buffer, chunk, &done, &overlapped) : ReadFile(handle, buffer, chunk, &done, &overlapped);
+        return ok ? done : 0;
+    }
+
+    void Close() {
+        if (IsOpen()) {
+            CloseHandle(handle);
+        }
+        handle = INVALID_HANDLE_VALUE;
+    }
+#else
+    int handle = -1;
+
+    uint64_t Transfer(uint8_t* buffer, uint64_t size, uint64_t offset, bool write) const {
+        size_t chunk = size_t(std::min<uint64_t>(size, 1u << 30));
+        ssize_t done = write ? pwrite(handle, buffer, chunk, off_t(offset)) : pread(handle, buffer, chunk, off_t(offset));
+        return done > 0 ? uint64_t(done) : 0;
+    }
+
+    void Close() {
+        if (IsOpen()) {
+            close(handle);
+        }
+        handle = -1;
+    }
+#endif
+};
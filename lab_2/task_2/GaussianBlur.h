@@ -0,0 +1,139 @@
+﻿#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Веса гауссова ядра 2 * radius + 1 в фиксированной точке, сумма ровно 1 << kGaussShift
+constexpr int kGaussShift = 14;
+
+inline std::vector<uint16_t> MakeGaussianTaps(int radius, double sigma) {
+    std::vector<double> weights(2 * radius + 1);
+    double total = 0;
+    for (int i = -radius; i <= radius; ++i) {
+        weights[i + radius] = std::exp(-(i * i) / (2 * sigma * sigma));
+        total += weights[i + radius];
+    }
+    std::vector<uint16_t> taps(weights.size());
+    int sum = 0;
+    for (size_t i = 0; i < taps.size(); ++i) {
+        taps[i] = static_cast<uint16_t>(std::lround(weights[i] / total * (1 << kGaussShift)));
+        sum += taps[i];
+    }
+    // Ошибку округления забирает центральный вес, иначе ровный цвет поплывёт
+    taps[radius] = static_cast<uint16_t>(taps[radius] + (1 << kGaussShift) - sum);
+    return taps;
+}
+
+// Радиусы n последовательных box-проходов, дающих в сумме дисперсию sigma^2
+// (расширенное box-размытие): стоимость на пиксель не зависит от sigma. Чтобы края
+// вели себя как у прямой свёртки, проходы идут по копии с полями (PadRowReplicate)
+// шириной в сумму радиусов: обрезка окна на краях копии до изображения не доходит.
+inline std::vector<int> BoxRadiiForGauss(double sigma, int passes) {
+    double ideal = std::sqrt(12 * sigma * sigma / passes + 1);
+    int lower = int(std::floor(ideal));
+    if (lower % 2 == 0) {
+        --lower;
+    }
+    int upper = lower + 2;
+    double m = (12 * sigma * sigma - passes * lower * lower - 4.0 * passes * lower - 3.0 * passes) / (-4.0 * lower - 4);
+    int smaller = int(std::lround(m));
+    std::vector<int> radii(passes);
+    for (int i = 0; i < passes; ++i) {
+        radii[i] = ((i < smaller ? lower : upper) - 1) / 2;
+    }
+    return radii;
+}
+
+// Строка row шириной width с полями в pad пикселей слева и справа, заполненными
+// крайними пикселями, в out (width + 2 * pad пикселей)
+template <int Channels>
+inline void PadRowReplicate(const uint8_t* row, int width, int pad, uint8_t* out) {
+    for (int x = 0; x < pad; ++x) {
+        std::memcpy(out + x * Channels, row, Channels);
+        std::memcpy(out + (pad + width + x) * Channels, row + (width - 1) * Channels, Channels);
+    }
+    std::memcpy(out + pad * Channels, row, size_t(width) * Channels);
+}
+
+// Разделимое гауссово размытие прямоугольника [x0, x1) x [y0, y1), края изображения
+// продолжаются крайними пикселями. Radius > 0 - радиус на этапе компиляции
+// (циклы по весам разворачиваются), Radius = 0 - радиус radiusArg.
+template <int Radius, int Channels>
+inline void GaussianBlurRectT(const uint8_t* src, uint8_t* dst, int width, int height, ptrdiff_t stride,
+    int x0, int y0, int x1, int y1, const uint16_t* taps, int radiusArg = Radius) {
+    const int radius = Radius > 0 ? Radius : radiusArg;
+    x1 = std::min(x1, width);
+    y1 = std::min(y1, height);
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    // Горизонтальный проход для строк с ореолом: 7 лишних бит точности в uint16
+    const int rowLen = (x1 - x0) * Channels;
+    const int haloY0 = y0 - radius;
+    const int rows = y1 - y0 + 2 * radius;
+    thread_local std::vector<uint16_t> horizontal;
+    horizontal.resize(size_t(rows) * rowLen);
+
+    int innerX0 = std::clamp(radius, x0, x1);
+    int innerX1 = std::clamp(width - radius, innerX0, x1);
+    for (int r = 0; r < rows; ++r) {
+        const uint8_t* row = src + std::clamp(haloY0 + r, 0, height - 1) * stride;
+        uint16_t* out = horizontal.data() + size_t(r) * rowLen;
+        auto edge = [&](int x) {
+            for (int c = 0; c < Channels; ++c) {
+                uint32_t sum = 0;
+                for (int k = -radius; k <= radius; ++k) {
+                    sum += taps[k + radius] * row[std::clamp(x + k, 0, width - 1) * Channels + c];
+                }
+                out[(x - x0) * Channels + c] = static_cast<uint16_t>((sum + (1 << 6)) >> 7);
+            }
+        };
+        for (int x = x0; x < innerX0; ++x) {
+            edge(x);
+        }
+        for (int i = innerX0 * Channels; i < innerX1 * Channels; ++i) {
+            uint32_t sum = 0;
+            for (int k = -radius; k <= radius; ++k) {
+                sum += taps[k + radius] * row[i + k * Channels];
+            }
+            out[i - x0 * Channels] = static_cast<uint16_t>((sum + (1 << 6)) >> 7);
+        }
+        for (int x = innerX1; x < x1; ++x) {
+            edge(x);
+        }
+    }
+
+    // Вертикальный проход: строки ореола уже продолжены по краям
+    constexpr int shift = 2 * kGaussShift - 7;
+    for (int y = y0; y < y1; ++y) {
+        uint8_t* out = dst + y * stride + x0 * Channels;
+        const uint16_t* base = horizontal.data() + size_t(y - y0) * rowLen;
+        for (int i = 0; i < rowLen; ++i) {
+            uint32_t sum = 0;
+            for (int k = 0; k <= 2 * radius; ++k) {
+                sum += taps[k] * base[size_t(k) * rowLen + i];
+            }
+            out[i] = static_cast<uint8_t>(std::min<uint32_t>((sum + (1u << (shift - 1))) >> shift, 255));
+        }
+    }
+}
+
+// Специализации для частых радиусов, остальные - общий вариант
+template <int Channels>
+inline void GaussianBlurRectN(const uint8_t* src, uint8_t* dst, int width, int height, ptrdiff_t stride,
+    int x0, int y0, int x1, int y1, const std::vector<uint16_t>& taps) {
+    int radius = int(taps.size() / 2);
+    switch (radius) {
+    case 1: GaussianBlurRectT<1, Channels>(src, dst, width, height, stride, x0, y0, x1, y1, taps.data()); break;
+    case 2: GaussianBlurRectT<2, Channels>(src, dst, width, height, stride, x0, y0, x1, y1, taps.data()); break;
+    case 3: GaussianBlurRectT<3, Channels>(src, dst, width, height, stride, x0, y0, x1, y1, taps.data()); break;
+    case 4: GaussianBlurRectT<4, Channels>(src, dst, width, height, stride, x0, y0, x1, y1, taps.data()); break;
+    case 5: GaussianBlurRectT<5, Channels>(src, dst, width, height, stride, x0, y0, x1, y1, taps.data()); break;
+    case 7: GaussianBlurRectT<7, Channels>(src, dst, width, height, stride, x0, y0, x1, y1, taps.data()); break;
+    default: GaussianBlurRectT<0, Channels>(src, dst, width, height, stride, x0, y0, x1, y1, taps.data(), radius); break;
+    }
+}
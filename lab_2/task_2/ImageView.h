@@ -0,0 +1,25 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <vector>
+
+// Окно на BGR24 пиксели: строка y начинается с data + y * stride.
+// stride может быть отрицательным (BMP со строками снизу вверх).
+struct ImageView {
+    uint8_t* data = nullptr;
+    int width = 0;
+    int height = 0;
+    ptrdiff_t stride = 0;
+
+    uint8_t* Row(int y) const { return data + y * stride; }
+};
+
+// Буфер того же размера и с тем же шагом строк (включая знак), что у образца
+inline ImageView AllocateLike(const ImageView& like, std::vector<uint8_t>& storage) {
+    size_t rowBytes = size_t(std::abs(like.stride));
+    storage.assign(rowBytes * size_t(like.height), 0);
+    ImageView view = like;
+    view.data = storage.data() + (like.stride < 0 ? rowBytes * size_t(like.height - 1) : 0);
+    return view;
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include "BitmapPlusPlus.h"
+#include "ImageView.h"
+#include "ThreadPool.h"
+#include "TileScheduler.h"
+
+// Инкрементальное размытие: хранит исходник, последний результат и карту изменённых
+// плиток исходника. Update пересчитывает только плитки результата, до которых достаёт
+// окно фильтра (ореол halo) из изменённых плиток, так что время пересчёта зависит от
+// размера правки, а не изображения. blurTile(src, dst, tile) - размытие одной плитки.
+class IncrementalBlur {
+public:
+    using BlurTileFn = std::function<void(const ImageView&, const ImageView&, const Tile&)>;
+
+    IncrementalBlur(const ImageView& image, int tileW, int tileH, int halo, BlurTileFn blurTile)
+        : source(unsigned(image.width), unsigned(image.height)), result(unsigned(image.width), unsigned(image.height)),
+          tileW(tileW), tileH(tileH), halo(halo),
+          tilesX((image.width + tileW - 1) / tileW), tilesY((image.height + tileH - 1) / tileH),
+          dirty(size_t(tilesX) * tilesY, 1), blurTile(std::move(blurTile))
+    {
+        ImageView view = source.view();
+        for (int y = 0; y < image.height; ++y) {
+            std::memcpy(view.Row(y), image.Row(y), size_t(image.width) * 3);
+        }
+    }
+
+    int Width() const { return int(source.width()); }
+    int Height() const { return int(source.height()); }
+
+    // Исходник для правки; изменённые области нужно отметить через MarkDirty
+    ImageView Source() { return source.view(); }
+    ImageView Result() { return result.view(); }
+
+    void MarkDirty(int x0, int y0, int x1, int y1) {
+        x0 = std::max(x0, 0);
+        y0 = std::max(y0, 0);
+        x1 = std::min(x1, Width());
+        y1 = std::min(y1, Height());
+        if (x0 >= x1 || y0 >= y1) {
+            return;
+        }
+        for (int ty = y0 / tileH; ty <= (y1 - 1) / tileH; ++ty) {
+            for (int tx = x0 / tileW; tx <= (x1 - 1) / tileW; ++tx) {
+                dirty[size_t(ty) * tilesX + tx] = 1;
+            }
+        }
+    }
+
+    // Пересчитывает затронутые плитки результата; возвращает их число
+    size_t Update(ThreadPool& pool) {
+        // Изменённая плитка исходника влияет на плитки результата в пределах ореола
+        std::vector<uint8_t> affected(dirty.size(), 0);
+        const int reachX = (halo + tileW - 1) / tileW, reachY = (halo + tileH - 1) / tileH;
+        for (int ty = 0; ty < tilesY; ++ty) {
+            for (int tx = 0; tx < tilesX; ++tx) {
+                if (!dirty[size_t(ty) * tilesX + tx]) {
+                    continue;
+                }
+                for (int ny = std::max(ty - reachY, 0); ny <= std::min(ty + reachY, tilesY - 1); ++ny) {
+                    for (int nx = std::max(tx - reachX, 0); nx <= std::min(tx + reachX, tilesX - 1); ++nx) {
+                        affected[size_t(ny) * tilesX + nx] = 1;
+                    }
+                }
+            }
+        }
+
+        std::vector<Tile> tiles;
+        for (int ty = 0; ty < tilesY; ++ty) {
+            for (int tx = 0; tx < tilesX; ++tx) {
+                if (affected[size_t(ty) * tilesX + tx]) {
+                    tiles.push_back(Tile{ tx * tileW, ty * tileH, std::min((tx + 1) * tileW, Width()),
+                        std::min((ty + 1) * tileH, Height()), ty * tilesX + tx });
+                }
+            }
+        }
+        if (!tiles.empty()) {
+            TileScheduler scheduler(tiles, pool.Size());
+            ImageView src = source.view(), dst = result.view();
+            scheduler.Run(pool, [&](unsigned, const Tile& tile) {
+                blurTile(src, dst, tile);
+            });
+        }
+        std::fill(dirty.begin(), dirty.end(), 0);
+        return tiles.size();
+    }
+
+private:
+    bmp::Bitmap source;
+    bmp::Bitmap result;
+    int tileW, tileH, halo;
+    int tilesX, tilesY;
+    std::vector<uint8_t> dirty;
+    BlurTileFn blurTile;
+};
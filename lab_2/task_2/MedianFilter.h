@@ -0,0 +1,151 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Медианный фильтр с окном (2 * radius + 1)^2 методом Перро - Эбера: у каждого столбца своя
+// гистограмма его 2r + 1 строк, гистограмма окна при шаге вправо получает один столбец и
+// теряет другой. Гистограммы двухуровневые: 16 грубых корзин по 16 значений. Грубые
+// корзины окна обновляются на каждом шаге, а тонкие - лениво, только у той корзины, где
+// оказалась медиана. Стоимость на пиксель не зависит от радиуса.
+// Окно обрезается по краям изображения, медиана - нижняя (элемент (n - 1) / 2 по порядку).
+struct MedianHistogram {
+    uint16_t coarse[16];
+    uint16_t fine[256];
+};
+
+template <int Channels>
+inline void MedianFilterRect(const uint8_t* src, uint8_t* dst, int width, int height, ptrdiff_t stride,
+    int x0, int y0, int x1, int y1, int radius) {
+    x1 = std::min(x1, width);
+    y1 = std::min(y1, height);
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    // Столбцы [cx0, cx1): плитка с ореолом по x, обрезанная по изображению
+    const int cx0 = std::max(x0 - radius, 0);
+    const int cx1 = std::min(x1 + radius, width);
+    const int columns = cx1 - cx0;
+    thread_local std::vector<MedianHistogram> colHist;
+    colHist.assign(size_t(columns) * Channels, MedianHistogram{});
+    auto column = [&](int x, int c) -> MedianHistogram& { return colHist[size_t(x - cx0) * Channels + c]; };
+
+    auto addRow = [&](int y, int delta) {
+        const uint8_t* row = src + y * stride;
+        for (int x = cx0; x < cx1; ++x) {
+            for (int c = 0; c < Channels; ++c) {
+                uint8_t v = row[x * Channels + c];
+                MedianHistogram& h = column(x, c);
+                h.coarse[v >> 4] = static_cast<uint16_t>(h.coarse[v >> 4] + delta);
+                h.fine[v] = static_cast<uint16_t>(h.fine[v] + delta);
+            }
+        }
+    };
+    for (int y = std::max(y0 - radius, 0); y <= std::min(y0 + radius, height - 1); ++y) {
+        addRow(y, 1);
+    }
+
+    uint32_t coarse[Channels][16];
+    uint32_t fine[Channels][16][16];
+    int fineAt[Channels][16];   // позиция окна, для которой актуальны fine[c][k]
+
+    for (int y = y0; y < y1; ++y) {
+        const int rows = std::min(y + radius, height - 1) - std::max(y - radius, 0) + 1;
+        uint8_t* out = dst + y * stride;
+
+        std::memset(coarse, 0, sizeof(coarse));
+        for (int x = std::max(x0 - radius, 0); x <= std::min(x0 + radius, width - 1); ++x) {
+            for (int c = 0; c < Channels; ++c) {
+                const MedianHistogram& h = column(x, c);
+                for (int k = 0; k < 16; ++k) {
+                    coarse[c][k] += h.coarse[k];
+                }
+            }
+        }
+        for (int c = 0; c < Channels; ++c) {
+            for (int k = 0; k < 16; ++k) {
+                fineAt[c][k] = INT32_MIN / 2;
+            }
+        }
+
+        for (int x = x0; x < x1; ++x) {
+            const int count = (std::min(x + radius, width - 1) - std::max(x - radius, 0) + 1) * rows;
+            const uint32_t rank = uint32_t(count - 1) / 2;
+            for (int c = 0; c < Channels; ++c) {
+                // Грубая корзина медианы
+                uint32_t below = 0;
+                int k = 0;
+                while (below + coarse[c][k] <= rank) {
+                    below += coarse[c][k];
+                    ++k;
+                }
+
+                // Догоняем тонкие корзины k до окна в позиции x
+                uint32_t* f = fine[c][k];
+                int& at = fineAt[c][k];
+                if (x - at > 2 * radius) {
+                    std::memset(f, 0, sizeof(fine[c][k]));
+                    for (int cx = std::max(x - radius, 0); cx <= std::min(x + radius, width - 1); ++cx) {
+                        const uint16_t* hf = column(cx, c).fine + k * 16;
+                        for (int i = 0; i < 16; ++i) {
+                            f[i] += hf[i];
+                        }
+                    }
+                } else {
+                    for (int p = at + 1; p <= x; ++p) {
+                        if (p + radius < width) {
+                            const uint16_t* hf = column(p + radius, c).fine + k * 16;
+                            for (int i = 0; i < 16; ++i) {
+                                f[i] += hf[i];
+                            }
+                        }
+                        if (p - radius - 1 >= 0) {
+                            const uint16_t* hf = column(p - radius - 1, c).fine + k * 16;
+                            for (int i = 0; i < 16; ++i) {
+                                f[i] -= hf[i];
+                            }
+                        }
+                    }
+                }
+                at = x;
+
+                int i = 0;
+                while (below + f[i] <= rank) {
+                    below += f[i];
+                    ++i;
+                }
+                out[x * Channels + c] = static_cast<uint8_t>(k * 16 + i);
+            }
+
+            // Сдвиг грубых корзин окна на x + 1
+            int add = x + radius + 1, sub = x - radius;
+            for (int c = 0; c < Channels; ++c) {
+                if (add < cx1) {
+                    const MedianHistogram& h = column(add, c);
+                    for (int k = 0; k < 16; ++k) {
+                        coarse[c][k] += h.coarse[k];
+                    }
+                }
+                if (sub >= 0) {
+                    const MedianHistogram& h = column(sub, c);
+                    for (int k = 0; k < 16; ++k) {
+                        coarse[c][k] -= h.coarse[k];
+                    }
+                }
+            }
+        }
+
+        // Гистограммы столбцов на строку y + 1
+        if (y + 1 < y1) {
+            if (y - radius >= 0) {
+                addRow(y - radius, -1);
+            }
+            if (y + radius + 1 < height) {
+                addRow(y + radius + 1, 1);
+            }
+        }
+    }
+}
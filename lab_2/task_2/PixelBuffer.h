@@ -0,0 +1,121 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "AlignedBuffer.h"
+#include "ImageView.h"
+
+struct Pixel {
+    uint8_t blue, green, red;
+};
+
+// Одна плоскость (канал) изображения: байт на пиксель, строка y с data + y * stride
+struct PlaneView {
+    uint8_t* data = nullptr;
+    int width = 0;
+    int height = 0;
+    ptrdiff_t stride = 0;
+
+    uint8_t* Row(int y) const { return data + y * stride; }
+};
+
+enum class PixelLayout {
+    Interleaved,  // BGRBGR... как в файле
+    Planar        // в каждой строке подряд плоскости B, G, R
+};
+
+// Изображение BGR24 в одном буфере, выровненном на 64 байта. Шаг строки один и тот же
+// для обоих представлений: 3 плоскости по planeStride = ширина, округлённая до 64 байт,
+// так что каждая плоскость каждой строки тоже выровнена. Поэтому смена представления
+// идёт на месте, строка за строкой, без второго буфера под изображение. В Planar
+// плоскость канала по всему изображению - PlaneView с шагом Stride(): на нём работают
+// поканальные ядра плоского режима (task_2 --planar).
+class PixelBuffer {
+public:
+    static constexpr size_t kAlignment = kBufferAlignment;
+
+    PixelBuffer() = default;
+    PixelBuffer(int width, int height, PixelLayout layout = PixelLayout::Interleaved)
+        : width(width), height(height), layout(layout),
+          planeStride((size_t(width) + kAlignment - 1) / kAlignment * kAlignment),
+          stride(3 * planeStride)
+    {
+        data = AllocateAligned(stride * size_t(height));
+        std::memset(data.get(), 0, stride * size_t(height));
+    }
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+    PixelLayout Layout() const { return layout; }
+    size_t Stride() const { return stride; }
+    size_t PlaneStride() const { return planeStride; }
+
+    uint8_t* Row(int y) { return data.get() + size_t(y) * stride; }
+    const uint8_t* Row(int y) const { return data.get() + size_t(y) * stride; }
+
+    // Плоскость канала c (0 - B, 1 - G, 2 - R) в строке y; только для Planar
+    uint8_t* Plane(int c, int y) { return Row(y) + size_t(c) * planeStride; }
+    const uint8_t* Plane(int c, int y) const { return Row(y) + size_t(c) * planeStride; }
+
+    // Плоскость канала c целиком; только для Planar. Как и ImageView, окно не переносит
+    // константность буфера.
+    PlaneView Plane(int c) const {
+        return PlaneView{ data.get() + size_t(c) * planeStride, width, height, ptrdiff_t(stride) };
+    }
+
+    // Шаги до соседнего пикселя и до следующего канала в текущем представлении
+    size_t PixelStep() const { return layout == PixelLayout::Interleaved ? 3 : 1; }
+    size_t ChannelStep() const { return layout == PixelLayout::Interleaved ? 1 : planeStride; }
+
+    Pixel Get(int x, int y) const {
+        const uint8_t* p = Row(y) + x * PixelStep();
+        size_t c = ChannelStep();
+        return Pixel{ p[0], p[c], p[2 * c] };
+    }
+
+    void Set(int x, int y, const Pixel& pixel) {
+        uint8_t* p = Row(y) + x * PixelStep();
+        size_t c = ChannelStep();
+        p[0] = pixel.blue;
+        p[c] = pixel.green;
+        p[2 * c] = pixel.red;
+    }
+
+    // Окно BGR24; только для Interleaved
+    ImageView View() { return ImageView{ data.get(), width, height, ptrdiff_t(stride) }; }
+
+    void SetLayout(PixelLayout target) {
+        if (target == layout) {
+            return;
+        }
+        std::vector<uint8_t> scratch(stride);
+        for (int y = 0; y < height; ++y) {
+            uint8_t* row = Row(y);
+            std::memcpy(scratch.data(), row, stride);
+            if (target == PixelLayout::Planar) {
+                for (int x = 0; x < width; ++x) {
+                    row[x] = scratch[x * 3];
+                    row[planeStride + x] = scratch[x * 3 + 1];
+                    row[2 * planeStride + x] = scratch[x * 3 + 2];
+                }
+            } else {
+                for (int x = 0; x < width; ++x) {
+                    row[x * 3] = scratch[x];
+                    row[x * 3 + 1] = scratch[planeStride + x];
+                    row[x * 3 + 2] = scratch[2 * planeStride + x];
+                }
+            }
+        }
+        layout = target;
+    }
+
+private:
+    int width = 0;
+    int height = 0;
+    PixelLayout layout = PixelLayout::Interleaved;
+    size_t planeStride = 0;
+    size_t stride = 0;
+    AlignedBytes data;
+};
@@ -0,0 +1,142 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "ImageView.h"
+#include "PixelBuffer.h"
+#include "SimdBlur.h"
+
+// Плоский режим хранит изображение в PixelBuffer с PixelLayout::Planar: здесь разбор
+// строк BGR24 на его плоскости и обратная сборка (AVX2 при поддержке процессора).
+
+// Разбор строки BGR24 на плоскости и обратная сборка, count пикселей
+inline void UnpackRowScalar(const uint8_t* src, uint8_t* b, uint8_t* g, uint8_t* r, int count) {
+    for (int x = 0; x < count; ++x) {
+        b[x] = src[x * 3];
+        g[x] = src[x * 3 + 1];
+        r[x] = src[x * 3 + 2];
+    }
+}
+
+inline void PackRowScalar(const uint8_t* b, const uint8_t* g, const uint8_t* r, uint8_t* dst, int count) {
+    for (int x = 0; x < count; ++x) {
+        dst[x * 3] = b[x];
+        dst[x * 3 + 1] = g[x];
+        dst[x * 3 + 2] = r[x];
+    }
+}
+
+#ifdef SIMD_BLUR_X86
+
+// Маски pshufb для 16 пикселей (48 байт в трёх регистрах). Распаковка: канал c из
+// регистра k - байты 3i + c, попавшие в k-й блок по 16. Упаковка: байт 16k + j
+// берётся из канала (16k + j) % 3, пиксель (16k + j) / 3. 0x80 обнуляет байт.
+struct alignas(16) PlanarShuffleMasks {
+    uint8_t unpack[3][3][16];
+    uint8_t pack[3][3][16];
+
+    PlanarShuffleMasks() {
+        for (int c = 0; c < 3; ++c) {
+            for (int k = 0; k < 3; ++k) {
+                for (int i = 0; i < 16; ++i) {
+                    int byte = 3 * i + c;
+                    unpack[c][k][i] = byte / 16 == k ? uint8_t(byte % 16) : 0x80;
+                    int out = 16 * k + i;
+                    pack[k][c][i] = out % 3 == c ? uint8_t(out / 3) : 0x80;
+                }
+            }
+        }
+    }
+};
+
+inline const PlanarShuffleMasks& GetPlanarShuffleMasks() {
+    static const PlanarShuffleMasks masks;
+    return masks;
+}
+
+// AVX2: по 32 пикселя; в каждой 128-битной половине свои 16 пикселей
+SIMD_TARGET("avx2")
+inline void UnpackRowAvx2(const uint8_t* src, uint8_t* b, uint8_t* g, uint8_t* r, int count) {
+    const PlanarShuffleMasks& masks = GetPlanarShuffleMasks();
+    __m256i m[3][3];
+    for (int c = 0; c < 3; ++c) {
+        for (int k = 0; k < 3; ++k) {
+            m[c][k] = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(masks.unpack[c][k])));
+        }
+    }
+    uint8_t* planes[3] = { b, g, r };
+    int x = 0;
+    for (; x + 32 <= count; x += 32) {
+        const uint8_t* p = src + x * 3;
+        __m256i v[3];
+        for (int k = 0; k < 3; ++k) {
+            v[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * k))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48 + 16 * k)), 1);
+        }
+        for (int c = 0; c < 3; ++c) {
+            __m256i out = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(v[0], m[c][0]), _mm256_shuffle_epi8(v[1], m[c][1])),
+                _mm256_shuffle_epi8(v[2], m[c][2]));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(planes[c] + x), out);
+        }
+    }
+    UnpackRowScalar(src + x * 3, b + x, g + x, r + x, count - x);
+}
+
+SIMD_TARGET("avx2")
+inline void PackRowAvx2(const uint8_t* b, const uint8_t* g, const uint8_t* r, uint8_t* dst, int count) {
+    const PlanarShuffleMasks& masks = GetPlanarShuffleMasks();
+    __m256i m[3][3];
+    for (int k = 0; k < 3; ++k) {
+        for (int c = 0; c < 3; ++c) {
+            m[k][c] = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(masks.pack[k][c])));
+        }
+    }
+    const uint8_t* planes[3] = { b, g, r };
+    int x = 0;
+    for (; x + 32 <= count; x += 32) {
+        __m256i v[3];
+        for (int c = 0; c < 3; ++c) {
+            v[c] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(planes[c] + x));
+        }
+        uint8_t* p = dst + x * 3;
+        for (int k = 0; k < 3; ++k) {
+            __m256i out = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(v[0], m[k][0]), _mm256_shuffle_epi8(v[1], m[k][1])),
+                _mm256_shuffle_epi8(v[2], m[k][2]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 16 * k), _mm256_castsi256_si128(out));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p + 48 + 16 * k), _mm256_extracti128_si256(out, 1));
+        }
+    }
+    PackRowScalar(b + x, g + x, r + x, dst + x * 3, count - x);
+}
+
+#endif // SIMD_BLUR_X86
+
+// Строки [y0, y1) окна src в строки [dstY, ...) плоскостей
+inline void UnpackRows(const ImageView& src, int y0, int y1, const PixelBuffer& dst, int dstY) {
+#ifdef SIMD_BLUR_X86
+    static const bool avx2 = IsBlurKernelSupported(BlurKernel::Avx2);
+    auto unpack = avx2 ? UnpackRowAvx2 : UnpackRowScalar;
+#else
+    auto unpack = UnpackRowScalar;
+#endif
+    PlaneView b = dst.Plane(0), g = dst.Plane(1), r = dst.Plane(2);
+    for (int y = y0; y < y1; ++y) {
+        int py = dstY + y - y0;
+        unpack(src.Row(y), b.Row(py), g.Row(py), r.Row(py), src.width);
+    }
+}
+
+// Строки [y0, y1) плоскостей в строки [dstY, ...) окна dst
+inline void PackRows(const PixelBuffer& src, int y0, int y1, const ImageView& dst, int dstY) {
+#ifdef SIMD_BLUR_X86
+    static const bool avx2 = IsBlurKernelSupported(BlurKernel::Avx2);
+    auto pack = avx2 ? PackRowAvx2 : PackRowScalar;
+#else
+    auto pack = PackRowScalar;
+#endif
+    PlaneView b = src.Plane(0), g = src.Plane(1), r = src.Plane(2);
+    for (int y = y0; y < y1; ++y) {
+        pack(b.Row(y), g.Row(y), r.Row(y), dst.Row(dstY + y - y0), src.Width());
+    }
+}
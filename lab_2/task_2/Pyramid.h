@@ -0,0 +1,240 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "ImageView.h"
+#include "PixelBuffer.h"
+#include "SimdBlur.h"
+#include "ThreadPool.h"
+
+// Пирамида уменьшений в 2 раза для BGR24: пиксель уровня k + 1 - среднее (с округлением)
+// квадрата 2x2 уровня k. У нечётной ширины или высоты последний столбец (строка)
+// берётся дважды.
+
+// Пиксели [x0, x1) строки уровня ниже по строкам r0, r1 уровня выше шириной inWidth
+inline void Downsample2xRowScalar(const uint8_t* r0, const uint8_t* r1, uint8_t* out, int inWidth, int x0, int x1) {
+    for (int x = x0; x < x1; ++x) {
+        const int a = 2 * x * 3, b = std::min(2 * x + 1, inWidth - 1) * 3;
+        for (int c = 0; c < 3; ++c) {
+            out[x * 3 + c] = static_cast<uint8_t>((r0[a + c] + r0[b + c] + r1[a + c] + r1[b + c] + 2) >> 2);
+        }
+    }
+}
+
+#ifdef SIMD_BLUR_X86
+
+// Байт j выходной строки - среднее байтов 2j - j % 3 и 2j - j % 3 + 3 двух строк. За шаг
+// 8 пикселей: 48 входных байт усредняются в 16 битах без разбора на каналы, затем
+// pshufb собирает из трёх 16-байтных частей нужные 24 байта.
+struct DownsampleShuffleMasks {
+    alignas(16) int8_t lo[2][16];   // байты 0..15 выхода из частей 0 и 1
+    alignas(16) int8_t hi[2][16];   // байты 16..23 выхода из частей 1 и 2
+
+    DownsampleShuffleMasks() {
+        std::fill(&lo[0][0], &lo[0][0] + 32, int8_t(-1));
+        std::fill(&hi[0][0], &hi[0][0] + 32, int8_t(-1));
+        for (int j = 0; j < 24; ++j) {
+            int from = 2 * j - j % 3;
+            int part = from / 16;
+            if (j < 16) {
+                lo[part][j] = int8_t(from % 16);
+            } else {
+                hi[part - 1][j - 16] = int8_t(from % 16);
+            }
+        }
+    }
+};
+
+inline const DownsampleShuffleMasks& GetDownsampleShuffleMasks() {
+    static const DownsampleShuffleMasks masks;
+    return masks;
+}
+
+SIMD_TARGET("sse4.1")
+inline void Downsample2xRowSse(const uint8_t* r0, const uint8_t* r1, uint8_t* out, int inWidth, int x0, int x1) {
+    const DownsampleShuffleMasks& masks = GetDownsampleShuffleMasks();
+    const __m128i lo0 = _mm_load_si128(reinterpret_cast<const __m128i*>(masks.lo[0]));
+    const __m128i lo1 = _mm_load_si128(reinterpret_cast<const __m128i*>(masks.lo[1]));
+    const __m128i hi0 = _mm_load_si128(reinterpret_cast<const __m128i*>(masks.hi[0]));
+    const __m128i hi1 = _mm_load_si128(reinterpret_cast<const __m128i*>(masks.hi[1]));
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+
+    int x = x0;
+    // Последнее чтение - байт 6x + 50 входной строки
+    for (; x + 8 <= x1 && 6 * x + 51 <= 3 * inWidth; x += 8) {
+        __m128i avg[3];
+        for (int part = 0; part < 3; ++part) {
+            __m128i lo = two, hi = two;
+            for (const uint8_t* r : { r0, r1 }) {
+                for (int dx : { 0, 3 }) {
+                    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r + 6 * x + part * 16 + dx));
+                    lo = _mm_add_epi16(lo, _mm_cvtepu8_epi16(v));
+                    hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+                }
+            }
+            avg[part] = _mm_packus_epi16(_mm_srli_epi16(lo, 2), _mm_srli_epi16(hi, 2));
+        }
+        __m128i first = _mm_or_si128(_mm_shuffle_epi8(avg[0], lo0), _mm_shuffle_epi8(avg[1], lo1));
+        __m128i second = _mm_or_si128(_mm_shuffle_epi8(avg[1], hi0), _mm_shuffle_epi8(avg[2], hi1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 3), first);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x * 3 + 16), second);
+    }
+    Downsample2xRowScalar(r0, r1, out, inWidth, x, x1);
+}
+
+// out = (a * wa + b * wb + 2^15) >> 16 по байтам; a, b - строки x 256, wa + wb = 256
+SIMD_TARGET("sse4.1")
+inline size_t BlendRowsSse(const uint16_t* a, const uint16_t* b, uint32_t wa, uint32_t wb, uint8_t* out, size_t count) {
+    const __m128i va = _mm_set1_epi32(int(wa)), vb = _mm_set1_epi32(int(wb));
+    const __m128i half = _mm_set1_epi32(1 << 15);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i words[2];
+        for (int k = 0; k < 2; ++k) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i + k * 8));
+            __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i + k * 8));
+            __m128i lo = _mm_add_epi32(_mm_mullo_epi32(_mm_cvtepu16_epi32(x), va), _mm_mullo_epi32(_mm_cvtepu16_epi32(y), vb));
+            __m128i hi = _mm_add_epi32(_mm_mullo_epi32(_mm_cvtepu16_epi32(_mm_srli_si128(x, 8)), va),
+                _mm_mullo_epi32(_mm_cvtepu16_epi32(_mm_srli_si128(y, 8)), vb));
+            lo = _mm_srli_epi32(_mm_add_epi32(lo, half), 16);
+            hi = _mm_srli_epi32(_mm_add_epi32(hi, half), 16);
+            words[k] = _mm_packus_epi32(lo, hi);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(words[0], words[1]));
+    }
+    return i;
+}
+
+#endif // SIMD_BLUR_X86
+
+// Следующий уровень: dst размером ((w + 1) / 2) x ((h + 1) / 2), строки параллельно
+inline void Downsample2x(ThreadPool& pool, const ImageView& src, const ImageView& dst) {
+#ifdef SIMD_BLUR_X86
+    static const bool sse = IsBlurKernelSupported(BlurKernel::Sse);
+    auto row = sse ? Downsample2xRowSse : Downsample2xRowScalar;
+#else
+    auto row = Downsample2xRowScalar;
+#endif
+    const unsigned jobs = pool.Size();
+    pool.Parallel(jobs, [&](unsigned job) {
+        int y0 = dst.height * int(job) / int(jobs), y1 = dst.height * int(job + 1) / int(jobs);
+        for (int y = y0; y < y1; ++y) {
+            const uint8_t* r0 = src.Row(2 * y);
+            const uint8_t* r1 = src.Row(std::min(2 * y + 1, src.height - 1));
+            row(r0, r1, dst.Row(y), src.width, 0, dst.width);
+        }
+    });
+}
+
+// Билинейное увеличение src до размера dst (центры пикселей совмещены, веса 8 бит).
+// Сначала по горизонтали: две соседние строки src, растянутые до ширины dst в 16 битах,
+// хранятся, пока не сменятся; затем каждая строка dst - смесь этих двух, простой
+// векторизуемый цикл по байтам.
+inline void UpsampleBilinear(ThreadPool& pool, const ImageView& src, const ImageView& dst) {
+    struct Sample {
+        int i0, i1;
+        uint16_t w1;   // вес второго соседа из 256
+    };
+    auto samples = [](int inSize, int outSize) {
+        std::vector<Sample> table(outSize);
+        for (int o = 0; o < outSize; ++o) {
+            double s = std::max((o + 0.5) * inSize / outSize - 0.5, 0.0);
+            int i0 = std::min(int(s), inSize - 1);
+            table[o] = Sample{ i0, std::min(i0 + 1, inSize - 1), uint16_t((s - i0) * 256 + 0.5) };
+        }
+        return table;
+    };
+    const std::vector<Sample> xs = samples(src.width, dst.width), ys = samples(src.height, dst.height);
+    const size_t rowBytes = size_t(dst.width) * 3;
+#ifdef SIMD_BLUR_X86
+    static const bool sse = IsBlurKernelSupported(BlurKernel::Sse);
+#endif
+
+    const unsigned jobs = pool.Size();
+    pool.Parallel(jobs, [&](unsigned job) {
+        // Строки src, растянутые по горизонтали (x 256), и их номера
+        std::vector<uint16_t> wide[2] = { std::vector<uint16_t>(rowBytes), std::vector<uint16_t>(rowBytes) };
+        int wideRow[2] = { -1, -1 };
+        auto widen = [&](int row, int slot) {
+            if (wideRow[slot] == row) {
+                return;
+            }
+            if (wideRow[slot ^ 1] == row) {
+                std::swap(wide[0], wide[1]);
+                std::swap(wideRow[0], wideRow[1]);
+                if (wideRow[slot] == row) {
+                    return;
+                }
+            }
+            const uint8_t* in = src.Row(row);
+            uint16_t* out = wide[slot].data();
+            for (int x = 0; x < dst.width; ++x) {
+                const Sample& sx = xs[x];
+                for (int c = 0; c < 3; ++c) {
+                    out[x * 3 + c] = uint16_t(in[sx.i0 * 3 + c] * (256 - sx.w1) + in[sx.i1 * 3 + c] * sx.w1);
+                }
+            }
+            wideRow[slot] = row;
+        };
+
+        int y0 = dst.height * int(job) / int(jobs), y1 = dst.height * int(job + 1) / int(jobs);
+        for (int y = y0; y < y1; ++y) {
+            const Sample& sy = ys[y];
+            widen(sy.i0, 0);
+            widen(sy.i1, 1);
+            const uint16_t* a = wide[0].data();
+            const uint16_t* b = wide[1].data();
+            const uint32_t wa = 256 - sy.w1, wb = sy.w1;
+            uint8_t* out = dst.Row(y);
+            size_t i = 0;
+#ifdef SIMD_BLUR_X86
+            if (sse) {
+                i = BlendRowsSse(a, b, wa, wb, out, rowBytes);
+            }
+#endif
+            for (; i < rowBytes; ++i) {
+                out[i] = static_cast<uint8_t>((a[i] * wa + b[i] * wb + (1u << 15)) >> 16);
+            }
+        }
+    });
+}
+
+// Наименьший номер уровня пирамиды над изображением width x height, где пикселей не больше maxPixels
+inline int PyramidLevelFor(int width, int height, uint64_t maxPixels) {
+    int level = 0;
+    while (uint64_t(width) * uint64_t(height) > maxPixels && std::max(width, height) > 1) {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        ++level;
+    }
+    return level;
+}
+
+// Уровень 0 - исходное окно (не копируется), остальные хранятся в своих буферах
+class ImagePyramid {
+public:
+    // Строит уровни 1 .. levels - 1 (пока обе стороны не станут равны 1)
+    void Build(ThreadPool& pool, const ImageView& base, int levels) {
+        baseView = base;
+        buffers.clear();
+        ImageView prev = base;
+        while (int(buffers.size()) + 1 < levels && std::max(prev.width, prev.height) > 1) {
+            buffers.emplace_back((prev.width + 1) / 2, (prev.height + 1) / 2);
+            ImageView next = buffers.back().View();
+            Downsample2x(pool, prev, next);
+            prev = next;
+        }
+    }
+
+    int Levels() const { return int(buffers.size()) + 1; }
+
+    ImageView Level(int level) {
+        return level == 0 ? baseView : buffers[level - 1].View();
+    }
+
+private:
+    ImageView baseView;
+    std::vector<PixelBuffer> buffers;
+};
@@ -0,0 +1,351 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "ImageView.h"
+#include "PixelBuffer.h"
+#include "SimdBlur.h"
+#include "ThreadPool.h"
+#include "TileScheduler.h"
+
+// Разделимое изменение размера BGR24: сначала по горизонтали (строки источника в ширину
+// результата, 8 бит), затем по вертикали. Веса каждого выходного столбца и строки считаются
+// заранее: taps подряд идущих входных пикселей начиная с first, фиксированная точка 14 бит,
+// сумма весов ровно 1. При уменьшении ядро растягивается в 1 / scale раз (сглаживание).
+// За краем изображения - крайние пиксели (их веса складываются с весом края).
+enum class ResampleFilter {
+    Box,
+    Bilinear,
+    Lanczos3
+};
+
+constexpr int kResampleBits = 14;
+
+inline const char* ResampleFilterName(ResampleFilter filter) {
+    switch (filter) {
+    case ResampleFilter::Box: return "box";
+    case ResampleFilter::Bilinear: return "bilinear";
+    case ResampleFilter::Lanczos3: return "lanczos3";
+    }
+    return "unknown";
+}
+
+inline bool ParseResampleFilter(const std::string& name, ResampleFilter& filter) {
+    for (ResampleFilter f : { ResampleFilter::Box, ResampleFilter::Bilinear, ResampleFilter::Lanczos3 }) {
+        if (name == ResampleFilterName(f)) {
+            filter = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Полуширина ядра и его значение в точке x (в пикселях входа при масштабе 1)
+inline double ResampleSupport(ResampleFilter filter) {
+    switch (filter) {
+    case ResampleFilter::Box: return 0.5;
+    case ResampleFilter::Bilinear: return 1.0;
+    case ResampleFilter::Lanczos3: return 3.0;
+    }
+    return 1.0;
+}
+
+inline double ResampleKernel(ResampleFilter filter, double x) {
+    switch (filter) {
+    case ResampleFilter::Box:
+        return x >= -0.5 && x < 0.5 ? 1.0 : 0.0;
+    case ResampleFilter::Bilinear:
+        return std::max(1.0 - std::abs(x), 0.0);
+    case ResampleFilter::Lanczos3: {
+        if (x == 0) {
+            return 1.0;
+        }
+        if (std::abs(x) >= 3) {
+            return 0.0;
+        }
+        const double pi = std::acos(-1.0);
+        return 3 * std::sin(pi * x) * std::sin(pi * x / 3) / (pi * pi * x * x);
+    }
+    }
+    return 0.0;
+}
+
+// Веса одной оси: выход o = sum weights[o * taps + k] * in[first[o] + k]
+struct ResampleAxis {
+    int taps = 0;
+    std::vector<int> first;
+    std::vector<int16_t> weights;
+};
+
+inline ResampleAxis MakeResampleAxis(int inSize, int outSize, ResampleFilter filter) {
+    const double scale = double(outSize) / inSize;
+    const double filterScale = std::max(1.0 / scale, 1.0);
+    const double support = ResampleSupport(filter) * filterScale;
+
+    // Веса в double по обрезанному краями диапазону [lo, lo + size)
+    std::vector<int> lows(outSize);
+    std::vector<std::vector<double>> raw(outSize);
+    ResampleAxis axis;
+    for (int o = 0; o < outSize; ++o) {
+        const double center = (o + 0.5) / scale;
+        const int i0 = int(std::floor(center - support)), i1 = int(std::ceil(center + support));
+        const int lo = std::clamp(i0, 0, inSize - 1), hi = std::clamp(i1, 0, inSize - 1);
+        std::vector<double>& w = raw[o];
+        w.assign(size_t(hi - lo + 1), 0.0);
+        for (int i = i0; i <= i1; ++i) {
+            w[std::clamp(i, 0, inSize - 1) - lo] += ResampleKernel(filter, (i + 0.5 - center) / filterScale);
+        }
+        // Нулевые веса по краям не нужны
+        size_t begin = 0, end = w.size();
+        while (end > begin + 1 && w[end - 1] == 0) {
+            --end;
+        }
+        while (begin + 1 < end && w[begin] == 0) {
+            ++begin;
+        }
+        w = std::vector<double>(w.begin() + begin, w.begin() + end);
+        lows[o] = lo + int(begin);
+        axis.taps = std::max(axis.taps, int(w.size()));
+    }
+
+    axis.first.resize(outSize);
+    axis.weights.assign(size_t(outSize) * axis.taps, 0);
+    for (int o = 0; o < outSize; ++o) {
+        const std::vector<double>& w = raw[o];
+        // Все taps пикселей должны быть внутри входа
+        const int first = std::min(lows[o], inSize - axis.taps);
+        const int shift = lows[o] - first;
+        axis.first[o] = first;
+
+        double sum = 0;
+        for (double v : w) {
+            sum += v;
+        }
+        int16_t* out = axis.weights.data() + size_t(o) * axis.taps;
+        int total = 0, largest = shift;
+        for (size_t k = 0; k < w.size(); ++k) {
+            double v = sum != 0 ? w[k] / sum : (k == 0 ? 1.0 : 0.0);
+            out[shift + k] = int16_t(std::lround(v * (1 << kResampleBits)));
+            total += out[shift + k];
+            if (out[shift + k] > out[largest]) {
+                largest = shift + int(k);
+            }
+        }
+        // Ошибку округления - в наибольший вес, чтобы сумма была ровно 1
+        out[largest] = int16_t(out[largest] + (1 << kResampleBits) - total);
+    }
+    return axis;
+}
+
+inline uint8_t ResampleRound(int32_t acc) {
+    return static_cast<uint8_t>(std::clamp((acc + (1 << (kResampleBits - 1))) >> kResampleBits, 0, 255));
+}
+
+// Пиксели [x0, x1) строки out из строки in по весам оси x; Channels байт на пиксель
+template <int Channels = 3>
+inline void ResampleRowScalar(const uint8_t* in, uint8_t* out, const ResampleAxis& axis, int x0, int x1) {
+    for (int x = x0; x < x1; ++x) {
+        const uint8_t* p = in + axis.first[x] * Channels;
+        const int16_t* w = axis.weights.data() + size_t(x) * axis.taps;
+        int32_t acc[Channels] = {};
+        for (int k = 0; k < axis.taps; ++k) {
+            for (int c = 0; c < Channels; ++c) {
+                acc[c] += w[k] * p[k * Channels + c];
+            }
+        }
+        for (int c = 0; c < Channels; ++c) {
+            out[x * Channels + c] = ResampleRound(acc[c]);
+        }
+    }
+}
+
+// Байты [i0, i1) строки out - взвешенная сумма строк rows[k]
+inline void ResampleColumnScalar(const uint8_t* const* rows, const int16_t* w, int taps, uint8_t* out, size_t i0, size_t i1) {
+    for (size_t i = i0; i < i1; ++i) {
+        int32_t acc = 0;
+        for (int k = 0; k < taps; ++k) {
+            acc += w[k] * rows[k][i];
+        }
+        out[i] = ResampleRound(acc);
+    }
+}
+
+#ifdef SIMD_BLUR_X86
+
+// Пиксель за шаг, по два отвода: байты двух пикселей чередуются (B0 B1 G0 G1 R0 R1 . .),
+// pmaddwd с парой весов даёт суммы B, G, R в 32 битах. Читает 4 байта на пиксель, поэтому
+// годится для выходных пикселей, чей последний отвод - не последний пиксель строки.
+SIMD_TARGET("sse4.1")
+inline void ResampleRowSse(const uint8_t* in, uint8_t* out, const ResampleAxis& axis, int x0, int x1) {
+    const __m128i half = _mm_set1_epi32(1 << (kResampleBits - 1));
+    auto load = [](const uint8_t* p) {
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        return _mm_cvtsi32_si128(int(v));
+    };
+    for (int x = x0; x < x1; ++x) {
+        const uint8_t* p = in + axis.first[x] * 3;
+        const int16_t* w = axis.weights.data() + size_t(x) * axis.taps;
+        __m128i acc = half;
+        int k = 0;
+        for (; k + 1 < axis.taps; k += 2) {
+            __m128i px = _mm_cvtepu8_epi16(_mm_unpacklo_epi8(load(p + k * 3), load(p + k * 3 + 3)));
+            __m128i wv = _mm_set1_epi32(int(uint16_t(w[k]) | (uint32_t(uint16_t(w[k + 1])) << 16)));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(px, wv));
+        }
+        if (k < axis.taps) {
+            __m128i px = _mm_cvtepu8_epi16(load(p + k * 3));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi16(px, _mm_setzero_si128()), _mm_set1_epi32(w[k] & 0xFFFF)));
+        }
+        acc = _mm_srai_epi32(acc, kResampleBits);
+        __m128i words = _mm_packs_epi32(acc, acc);
+        __m128i bytes = _mm_packus_epi16(words, words);
+        uint32_t v = uint32_t(_mm_cvtsi128_si32(bytes));
+        std::memcpy(out + x * 3, &v, 3);
+    }
+}
+
+// 16 байт за шаг, по две строки: чередование байтов строк k и k + 1, pmaddwd с парой весов
+SIMD_TARGET("sse4.1")
+inline size_t ResampleColumnSse(const uint8_t* const* rows, const int16_t* w, int taps, uint8_t* out, size_t count) {
+    const __m128i half = _mm_set1_epi32(1 << (kResampleBits - 1));
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i acc[4] = { half, half, half, half };
+        for (int k = 0; k < taps; k += 2) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k] + i));
+            __m128i b = k + 1 < taps ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[k + 1] + i)) : zero;
+            __m128i wv = _mm_set1_epi32(int(uint16_t(w[k]) | (k + 1 < taps ? uint32_t(uint16_t(w[k + 1])) << 16 : 0u)));
+            __m128i lo = _mm_unpacklo_epi8(a, b), hi = _mm_unpackhi_epi8(a, b);
+            acc[0] = _mm_add_epi32(acc[0], _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), wv));
+            acc[1] = _mm_add_epi32(acc[1], _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), wv));
+            acc[2] = _mm_add_epi32(acc[2], _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), wv));
+            acc[3] = _mm_add_epi32(acc[3], _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), wv));
+        }
+        for (__m128i& v : acc) {
+            v = _mm_srai_epi32(v, kResampleBits);
+        }
+        __m128i words0 = _mm_packs_epi32(acc[0], acc[1]), words1 = _mm_packs_epi32(acc[2], acc[3]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(words0, words1));
+    }
+    return i;
+}
+
+#endif // SIMD_BLUR_X86
+
+// Изменение размера inWidth x inHeight -> outWidth x outHeight с готовыми таблицами весов
+class Resampler {
+public:
+    Resampler(int inWidth, int inHeight, int outWidth, int outHeight, ResampleFilter filter)
+        : outWidth(outWidth), outHeight(outHeight),
+          xAxis(MakeResampleAxis(inWidth, outWidth, filter)), yAxis(MakeResampleAxis(inHeight, outHeight, filter))
+    {
+        // Выходные пиксели [0, simdEnd) читают 4 байта на отвод, не выходя за строку
+        simdEnd = 0;
+        while (simdEnd < outWidth && xAxis.first[simdEnd] + xAxis.taps < inWidth) {
+            ++simdEnd;
+        }
+    }
+
+    int OutWidth() const { return outWidth; }
+    int OutHeight() const { return outHeight; }
+
+    // Строки источника [y0, y1), нужные для строк результата [outY0, outY1)
+    void SourceRows(int outY0, int outY1, int& y0, int& y1) const {
+        y0 = yAxis.first[outY0];
+        y1 = yAxis.first[outY1 - 1] + yAxis.taps;
+    }
+
+    // Строки результата [outY0, outY1); src содержит строки источника начиная с srcY0
+    void ResampleRows(const ImageView& src, int srcY0, const ImageView& dst, int outY0, int outY1) const {
+        ResampleRowsT<3>(src, srcY0, dst, 0, outY0, outY1);
+    }
+
+    // То же для одной плоскости (байт на пиксель); dst содержит строки результата начиная с dstY0
+    void ResampleRows(const PlaneView& src, int srcY0, const PlaneView& dst, int dstY0, int outY0, int outY1) const {
+        ResampleRowsT<1>(src, srcY0, dst, dstY0, outY0, outY1);
+    }
+
+    // Строки результата [outY0, outY1) полосами по bandRows строк на планировщике плиток
+    void Run(ThreadPool& pool, const ImageView& src, int srcY0, const ImageView& dst, int outY0, int outY1, int bandRows = 16) const {
+        RunBands(pool, 1, outY0, outY1, bandRows, [&](int, int y0, int y1) {
+            ResampleRows(src, srcY0, dst, y0, y1);
+        });
+    }
+
+    // Плоский режим: src и dst в PixelLayout::Planar (dst - строки результата начиная
+    // с dstY0), полосы всех трёх плоскостей - общий набор задач
+    void Run(ThreadPool& pool, const PixelBuffer& src, int srcY0, const PixelBuffer& dst, int dstY0,
+        int outY0, int outY1, int bandRows = 16) const {
+        RunBands(pool, 3, outY0, outY1, bandRows, [&](int c, int y0, int y1) {
+            ResampleRows(src.Plane(c), srcY0, dst.Plane(c), dstY0, y0, y1);
+        });
+    }
+
+private:
+    int outWidth, outHeight;
+    ResampleAxis xAxis, yAxis;
+    int simdEnd;
+
+    template <typename Fn>
+    void RunBands(ThreadPool& pool, int planes, int outY0, int outY1, int bandRows, Fn fn) const {
+        std::vector<Tile> bands;
+        for (int c = 0; c < planes; ++c) {
+            for (int y = outY0; y < outY1; y += bandRows) {
+                bands.push_back(Tile{ c, y, c + 1, std::min(y + bandRows, outY1), int(bands.size()) });
+            }
+        }
+        TileScheduler scheduler(bands, pool.Size());
+        scheduler.Run(pool, [&](unsigned, const Tile& band) {
+            fn(band.x0, band.y0, band.y1);
+        });
+    }
+
+    template <int Channels, typename View>
+    void ResampleRowsT(const View& src, int srcY0, const View& dst, int dstY0, int outY0, int outY1) const {
+        int y0, y1;
+        SourceRows(outY0, outY1, y0, y1);
+        // Промежуточные строки: источник, уже приведённый к ширине результата
+        const size_t rowBytes = size_t(outWidth) * Channels;
+        const size_t midStride = (rowBytes + 15) / 16 * 16;
+        thread_local std::vector<uint8_t> mid;
+        mid.resize(midStride * size_t(y1 - y0));
+
+#ifdef SIMD_BLUR_X86
+        static const bool sse = IsBlurKernelSupported(BlurKernel::Sse);
+#endif
+        for (int y = y0; y < y1; ++y) {
+            const uint8_t* in = src.Row(y - srcY0);
+            uint8_t* out = mid.data() + size_t(y - y0) * midStride;
+            int x = 0;
+#ifdef SIMD_BLUR_X86
+            if (Channels == 3 && sse) {
+                ResampleRowSse(in, out, xAxis, 0, simdEnd);
+                x = simdEnd;
+            }
+#endif
+            ResampleRowScalar<Channels>(in, out, xAxis, x, outWidth);
+        }
+
+        std::vector<const uint8_t*> rows(yAxis.taps);
+        for (int oy = outY0; oy < outY1; ++oy) {
+            for (int k = 0; k < yAxis.taps; ++k) {
+                rows[k] = mid.data() + size_t(yAxis.first[oy] + k - y0) * midStride;
+            }
+            const int16_t* w = yAxis.weights.data() + size_t(oy) * yAxis.taps;
+            uint8_t* out = dst.Row(oy - dstY0);
+            size_t i = 0;
+#ifdef SIMD_BLUR_X86
+            if (sse) {
+                i = ResampleColumnSse(rows.data(), w, yAxis.taps, out, rowBytes);
+            }
+#endif
+            ResampleColumnScalar(rows.data(), w, yAxis.taps, out, i, rowBytes);
+        }
+    }
+};
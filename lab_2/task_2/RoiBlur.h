@@ -0,0 +1,112 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "FileIO.h"
+#include "ImageView.h"
+#include "MappedBMP.h"
+#include "StripStream.h"
+
+struct RoiRect {
+    int x0, y0, x1, y1;
+};
+
+struct RoiStats {
+    int rects = 0;
+    uint64_t bytesRead = 0;
+    uint64_t bytesWritten = 0;
+    uint64_t imageBytes = 0;
+};
+
+// Прямоугольники "x0 y0 x1 y1" по одному в строке, границы полуоткрытые
+inline std::vector<RoiRect> LoadRoiRects(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Could not open ROI file: " + path);
+    }
+    std::vector<RoiRect> rects;
+    RoiRect rect;
+    while (in >> rect.x0 >> rect.y0 >> rect.x1 >> rect.y1) {
+        rects.push_back(rect);
+    }
+    return rects;
+}
+
+// Размытие только прямоугольников: для каждого читаются (pread) его строки и столбцы
+// с ореолом в halo пикселей, blur(src, dst, y0, y1) считает окно, и в файл результата
+// (pwrite) возвращаются только байты самого прямоугольника. Если результат - тот же файл,
+// правка идёт на месте; иначе сначала файл копируется целиком (copy_file, на файловых
+// системах с reflink - без копирования данных), а затем так же правится.
+// Все окна читаются и размываются до первой записи: иначе при правке на месте ореол
+// следующего прямоугольника (а он достаёт и до соседних, не только пересекающихся)
+// увидел бы уже размытые пиксели. Пересекающиеся пишутся по порядку, последний побеждает.
+template <typename BlurFn>
+inline RoiStats BlurRegions(const std::string& inputPath, const std::string& outputPath,
+    const std::vector<RoiRect>& rects, int halo, BlurFn blur) {
+    namespace fs = std::filesystem;
+    bool inPlace = fs::exists(outputPath) && fs::equivalent(inputPath, outputPath);
+    if (!inPlace) {
+        fs::copy_file(inputPath, outputPath, fs::copy_options::overwrite_existing);
+    }
+    // При правке на месте чтение и запись идут через один дескриптор
+    PositionalFile out = PositionalFile::OpenReadWrite(outputPath);
+    PositionalFile source = inPlace ? PositionalFile() : PositionalFile::OpenRead(inputPath);
+    const PositionalFile& in = inPlace ? out : source;
+    std::vector<uint8_t> prefix;
+    BMPLayout layout = ReadBMPPrefix(in, prefix);
+
+    RoiStats stats;
+    stats.imageBytes = layout.DataSize();
+    std::vector<uint8_t> srcBuffer, dstBuffer;
+    // Размытые прямоугольники (строки без выравнивания) до записи в файл
+    std::vector<std::pair<RoiRect, std::vector<uint8_t>>> patches;
+    for (RoiRect rect : rects) {
+        rect.x0 = std::clamp(rect.x0, 0, layout.width);
+        rect.x1 = std::clamp(rect.x1, rect.x0, layout.width);
+        rect.y0 = std::clamp(rect.y0, 0, layout.height);
+        rect.y1 = std::clamp(rect.y1, rect.y0, layout.height);
+        if (rect.x0 == rect.x1 || rect.y0 == rect.y1) {
+            continue;
+        }
+
+        // Окно с ореолом, строки сверху вниз без выравнивания
+        int wx0 = std::max(rect.x0 - halo, 0), wx1 = std::min(rect.x1 + halo, layout.width);
+        int wy0 = std::max(rect.y0 - halo, 0), wy1 = std::min(rect.y1 + halo, layout.height);
+        ImageView src{ nullptr, wx1 - wx0, wy1 - wy0, ptrdiff_t(wx1 - wx0) * 3 };
+        srcBuffer.resize(size_t(src.stride) * src.height);
+        dstBuffer.resize(srcBuffer.size());
+        src.data = srcBuffer.data();
+        ImageView dst = src;
+        dst.data = dstBuffer.data();
+
+        for (int y = wy0; y < wy1; ++y) {
+            in.ReadAt(src.Row(y - wy0), uint64_t(src.stride), layout.RowOffset(y) + uint64_t(wx0) * 3);
+        }
+        stats.bytesRead += srcBuffer.size();
+
+        blur(src, dst, rect.y0 - wy0, rect.y1 - wy0);
+
+        size_t spanBytes = size_t(rect.x1 - rect.x0) * 3;
+        std::vector<uint8_t> patch(spanBytes * size_t(rect.y1 - rect.y0));
+        for (int y = rect.y0; y < rect.y1; ++y) {
+            std::memcpy(patch.data() + spanBytes * size_t(y - rect.y0), dst.Row(y - wy0) + (rect.x0 - wx0) * 3, spanBytes);
+        }
+        patches.emplace_back(rect, std::move(patch));
+    }
+
+    for (const auto& [rect, patch] : patches) {
+        size_t spanBytes = size_t(rect.x1 - rect.x0) * 3;
+        for (int y = rect.y0; y < rect.y1; ++y) {
+            out.WriteAt(patch.data() + spanBytes * size_t(y - rect.y0), spanBytes, layout.RowOffset(y) + uint64_t(rect.x0) * 3);
+        }
+        stats.bytesWritten += patch.size();
+        ++stats.rects;
+    }
+    return stats;
+}
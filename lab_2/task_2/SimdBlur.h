@@ -0,0 +1,246 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <algorithm>
+#include "BoxBlur.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_BLUR_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SIMD_TARGET(x) __attribute__((target(x)))
+#else
+#define SIMD_TARGET(x)
+#endif
+
+// Ядра размытия 3x3 для BGR24. Соседи того же канала лежат в строке на +-3 байта,
+// поэтому векторы обрабатывают байты строки без разбора на каналы:
+// сумма 9 байт в 16 битах, деление на 9 заменено на (sum * 7282) >> 16
+// (точно для sum <= 2295).
+enum class BlurKernel {
+    Scalar,
+    Sse,
+    Avx2,
+    Avx512
+};
+
+using BlurRectFn = void (*)(const uint8_t* src, uint8_t* dst, int width, int height, ptrdiff_t stride,
+    int x0, int y0, int x1, int y1);
+
+constexpr uint16_t kDiv9Mul = 7282;
+
+inline const char* BlurKernelName(BlurKernel kernel) {
+    switch (kernel) {
+    case BlurKernel::Sse: return "sse";
+    case BlurKernel::Avx2: return "avx2";
+    case BlurKernel::Avx512: return "avx512";
+    default: return "scalar";
+    }
+}
+
+inline bool ParseBlurKernel(const std::string& name, BlurKernel& kernel) {
+    for (BlurKernel k : { BlurKernel::Scalar, BlurKernel::Sse, BlurKernel::Avx2, BlurKernel::Avx512 }) {
+        if (name == BlurKernelName(k)) {
+            kernel = k;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void BlurRect3x3Scalar(const uint8_t* src, uint8_t* dst, int width, int height, ptrdiff_t stride,
+    int x0, int y0, int x1, int y1) {
+    BoxBlurRect(src, dst, width, height, stride, x0, y0, x1, y1, 1);
+}
+
+// Общая обвязка: края изображения считает скалярный код, внутренние байты строки
+// [begin, end) передаются векторному телу, которое возвращает обработанную длину.
+template <typename RowBody>
+inline void BlurRect3x3Rows(const uint8_t* src, uint8_t* dst, int width, int height, ptrdiff_t stride,
+    int x0, int y0, int x1, int y1, RowBody body) {
+    x1 = std::min(x1, width);
+    y1 = std::min(y1, height);
+    int xs = std::clamp(1, x0, x1);
+    int xe = std::clamp(width - 1, xs, x1);
+    for (int y = y0; y < y1; ++y) {
+        if (y == 0 || y == height - 1 || xs >= xe) {
+            BoxBlurRect(src, dst, width, height, stride, x0, y, x1, y + 1, 1);
+            continue;
+        }
+        if (x0 < xs) {
+            BoxBlurRect(src, dst, width, height, stride, x0, y, xs, y + 1, 1);
+        }
+        if (xe < x1) {
+            BoxBlurRect(src, dst, width, height, stride, xe, y, x1, y + 1, 1);
+        }
+
+        const uint8_t* r0 = src + (y - 1) * stride;
+        const uint8_t* r1 = src + y * stride;
+        const uint8_t* r2 = src + (y + 1) * stride;
+        uint8_t* out = dst + y * stride;
+        int begin = xs * 3, end = xe * 3;
+        int i = begin + body(r0, r1, r2, out, begin, end);
+        for (; i < end; ++i) {
+            uint32_t sum = r0[i - 3] + r0[i] + r0[i + 3]
+                + r1[i - 3] + r1[i] + r1[i + 3]
+                + r2[i - 3] + r2[i] + r2[i + 3];
+            out[i] = static_cast<uint8_t>((sum * kDiv9Mul) >> 16);
+        }
+    }
+}
+
+#ifdef SIMD_BLUR_X86
+
+SIMD_TARGET("sse4.1")
+inline int BlurRow3x3Sse(const uint8_t* r0, const uint8_t* r1, const uint8_t* r2, uint8_t* out, int begin, int end) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mul = _mm_set1_epi16(static_cast<short>(kDiv9Mul));
+    int i = begin;
+    for (; i + 16 <= end; i += 16) {
+        __m128i lo = zero, hi = zero;
+        for (const uint8_t* r : { r0, r1, r2 }) {
+            for (int dx : { -3, 0, 3 }) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r + i + dx));
+                lo = _mm_add_epi16(lo, _mm_cvtepu8_epi16(v));
+                hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+            }
+        }
+        lo = _mm_mulhi_epu16(lo, mul);
+        hi = _mm_mulhi_epu16(hi, mul);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(lo, hi));
+    }
+    return i - begin;
+}
+
+SIMD_TARGET("avx2")
+inline int BlurRow3x3Avx2(const uint8_t* r0, const uint8_t* r1, const uint8_t* r2, uint8_t* out, int begin, int end) {
+    const __m256i mul = _mm256_set1_epi16(static_cast<short>(kDiv9Mul));
+    int i = begin;
+    for (; i + 32 <= end; i += 32) {
+        __m256i lo = _mm256_setzero_si256(), hi = _mm256_setzero_si256();
+        for (const uint8_t* r : { r0, r1, r2 }) {
+            for (int dx : { -3, 0, 3 }) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r + i + dx));
+                lo = _mm256_add_epi16(lo, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+                hi = _mm256_add_epi16(hi, _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+            }
+        }
+        lo = _mm256_mulhi_epu16(lo, mul);
+        hi = _mm256_mulhi_epu16(hi, mul);
+        // packus работает по 128-битным половинам, возвращаем порядок байт
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+    }
+    return i - begin;
+}
+
+SIMD_TARGET("avx512f,avx512bw")
+inline int BlurRow3x3Avx512(const uint8_t* r0, const uint8_t* r1, const uint8_t* r2, uint8_t* out, int begin, int end) {
+    const __m512i mul = _mm512_set1_epi16(static_cast<short>(kDiv9Mul));
+    const __m512i order = _mm512_set_epi64(7, 5, 3, 1, 6, 4, 2, 0);
+    int i = begin;
+    for (; i + 64 <= end; i += 64) {
+        __m512i lo = _mm512_setzero_si512(), hi = _mm512_setzero_si512();
+        for (const uint8_t* r : { r0, r1, r2 }) {
+            for (int dx : { -3, 0, 3 }) {
+                __m512i v = _mm512_loadu_si512(r + i + dx);
+                lo = _mm512_add_epi16(lo, _mm512_cvtepu8_epi16(_mm512_castsi512_si256(v)));
+                hi = _mm512_add_epi16(hi, _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(v, 1)));
+            }
+        }
+        lo = _mm512_mulhi_epu16(lo, mul);
+        hi = _mm512_mulhi_epu16(hi, mul);
+        __m512i packed = _mm512_permutexvar_epi64(order, _mm512_packus_epi16(lo, hi));
+        _mm512_storeu_si512(out + i, packed);
+    }
+    return i - begin;
+}
+
+inline void BlurRect3x3Sse(const uint8_t* src, uint8_t* dst, int width, int height, ptrdiff_t stride,
+    int x0, int y0, int x1, int y1) {
+    BlurRect3x3Rows(src, dst, width, height, stride, x0, y0, x1, y1, BlurRow3x3Sse);
+}
+
+inline void BlurRect3x3Avx2(const uint8_t* src, uint8_t* dst, int width, int height, ptrdiff_t stride,
+    int x0, int y0, int x1, int y1) {
+    BlurRect3x3Rows(src, dst, width, height, stride, x0, y0, x1, y1, BlurRow3x3Avx2);
+}
+
+inline void BlurRect3x3Avx512(const uint8_t* src, uint8_t* dst, int width, int height, ptrdiff_t stride,
+    int x0, int y0, int x1, int y1) {
+    BlurRect3x3Rows(src, dst, width, height, stride, x0, y0, x1, y1, BlurRow3x3Avx512);
+}
+
+struct CpuFeatures {
+    bool sse41 = false;
+    bool avx2 = false;
+    bool avx512bw = false;
+};
+
+// CPUID + XGETBV: инструкции должен поддерживать и процессор, и ОС (сохранение регистров)
+inline CpuFeatures DetectCpuFeatures() {
+    CpuFeatures features;
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    features.sse41 = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    if (maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        features.avx2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+        features.avx512bw = (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0 && (xcr0 & 0xE6) == 0xE6;
+    }
+#else
+    __builtin_cpu_init();
+    features.sse41 = __builtin_cpu_supports("sse4.1");
+    features.avx2 = __builtin_cpu_supports("avx2");
+    features.avx512bw = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+    return features;
+}
+
+#endif // SIMD_BLUR_X86
+
+inline bool IsBlurKernelSupported(BlurKernel kernel) {
+#ifdef SIMD_BLUR_X86
+    static const CpuFeatures features = DetectCpuFeatures();
+    switch (kernel) {
+    case BlurKernel::Sse: return features.sse41;
+    case BlurKernel::Avx2: return features.avx2;
+    case BlurKernel::Avx512: return features.avx512bw;
+    default: return true;
+    }
+#else
+    return kernel == BlurKernel::Scalar;
+#endif
+}
+
+inline BlurKernel DetectBestBlurKernel() {
+    for (BlurKernel k : { BlurKernel::Avx512, BlurKernel::Avx2, BlurKernel::Sse }) {
+        if (IsBlurKernelSupported(k)) {
+            return k;
+        }
+    }
+    return BlurKernel::Scalar;
+}
+
+inline BlurRectFn GetBlurKernel(BlurKernel kernel) {
+#ifdef SIMD_BLUR_X86
+    switch (kernel) {
+    case BlurKernel::Sse: return BlurRect3x3Sse;
+    case BlurKernel::Avx2: return BlurRect3x3Avx2;
+    case BlurKernel::Avx512: return BlurRect3x3Avx512;
+    default: break;
+    }
+#endif
+    return BlurRect3x3Scalar;
+}
@@ -0,0 +1,156 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "BoxBlur.h"
+#include "ImageView.h"
+#include "SimdBlur.h"
+#include "TileScheduler.h"
+
+enum class StencilKind {
+    Blur,       // среднее в окне (2r + 1)^2, param - радиус
+    Sharpen,    // 5c - 4 соседа
+    Sobel,      // |Gx| + |Gy| по каждому каналу
+    Threshold   // яркость >= param -> белый, иначе чёрный
+};
+
+struct StencilStage {
+    StencilKind kind = StencilKind::Blur;
+    int param = 1;
+
+    // Сколько пикселей вокруг нужно этапу
+    int Halo() const {
+        switch (kind) {
+        case StencilKind::Blur: return param;
+        case StencilKind::Threshold: return 0;
+        default: return 1;
+        }
+    }
+};
+
+// "blur:2,sharpen,sobel,threshold:128"
+inline bool ParseStencilPipeline(const std::string& spec, std::vector<StencilStage>& stages) {
+    stages.clear();
+    std::stringstream in(spec);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        size_t colon = item.find(':');
+        std::string name = item.substr(0, colon);
+        StencilStage stage;
+        if (name == "blur") {
+            stage = { StencilKind::Blur, 1 };
+        } else if (name == "sharpen") {
+            stage = { StencilKind::Sharpen, 0 };
+        } else if (name == "sobel") {
+            stage = { StencilKind::Sobel, 0 };
+        } else if (name == "threshold") {
+            stage = { StencilKind::Threshold, 128 };
+        } else {
+            return false;
+        }
+        if (colon != std::string::npos) {
+            stage.param = std::atoi(item.c_str() + colon + 1);
+        }
+        if (stage.kind == StencilKind::Blur && stage.param <= 0) {
+            return false;
+        }
+        stages.push_back(stage);
+    }
+    return !stages.empty();
+}
+
+inline int StencilHalo(const std::vector<StencilStage>& stages) {
+    int halo = 0;
+    for (const StencilStage& stage : stages) {
+        halo += stage.Halo();
+    }
+    return halo;
+}
+
+// Один этап над прямоугольником [x0, x1) x [y0, y1) изображения width x height,
+// src и dst с общим шагом строк. Соседи за краем изображения - крайние пиксели
+// (у размытия - только пиксели внутри, как в BoxBlurRect). blur3x3 - выбранное ядро
+// размытия 3x3 (--kernel), оно совпадает с BoxBlurRect радиуса 1 побайтно.
+inline void ApplyStencilStage(const StencilStage& stage, BlurRectFn blur3x3, const uint8_t* src, uint8_t* dst,
+    int width, int height, ptrdiff_t stride, int x0, int y0, int x1, int y1) {
+    if (stage.kind == StencilKind::Blur && stage.param == 1) {
+        blur3x3(src, dst, width, height, stride, x0, y0, x1, y1);
+        return;
+    }
+    if (stage.kind == StencilKind::Blur) {
+        BoxBlurRect(src, dst, width, height, stride, x0, y0, x1, y1, stage.param);
+        return;
+    }
+
+    for (int y = y0; y < y1; ++y) {
+        const uint8_t* up = src + std::max(y - 1, 0) * stride;
+        const uint8_t* mid = src + y * stride;
+        const uint8_t* down = src + std::min(y + 1, height - 1) * stride;
+        uint8_t* out = dst + y * stride;
+        for (int x = x0; x < x1; ++x) {
+            int l = std::max(x - 1, 0) * 3, c = x * 3, r = std::min(x + 1, width - 1) * 3;
+            switch (stage.kind) {
+            case StencilKind::Sharpen:
+                for (int k = 0; k < 3; ++k) {
+                    int v = 5 * mid[c + k] - up[c + k] - down[c + k] - mid[l + k] - mid[r + k];
+                    out[c + k] = static_cast<uint8_t>(std::clamp(v, 0, 255));
+                }
+                break;
+            case StencilKind::Sobel:
+                for (int k = 0; k < 3; ++k) {
+                    int gx = (up[r + k] + 2 * mid[r + k] + down[r + k]) - (up[l + k] + 2 * mid[l + k] + down[l + k]);
+                    int gy = (down[l + k] + 2 * down[c + k] + down[r + k]) - (up[l + k] + 2 * up[c + k] + up[r + k]);
+                    out[c + k] = static_cast<uint8_t>(std::min(std::abs(gx) + std::abs(gy), 255));
+                }
+                break;
+            default: {
+                // Яркость BT.601 в целых: (29 B + 150 G + 77 R) / 256
+                int luma = (29 * mid[c] + 150 * mid[c + 1] + 77 * mid[c + 2]) >> 8;
+                uint8_t v = luma >= stage.param ? 255 : 0;
+                out[c] = out[c + 1] = out[c + 2] = v;
+                break;
+            }
+            }
+        }
+    }
+}
+
+// Слитный проход всех этапов по одной плитке. Плитка с суммарным ореолом (обрезанным
+// по краям изображения) копируется в рабочий буфер потока; этап k считает плитку с
+// ореолом оставшихся этапов, читая результат этапа k - 1 из второго буфера. Край буфера
+// внутри изображения этапы не достают, а на краю изображения он с ним совпадает,
+// поэтому результат побайтно равен последовательным проходам по всему изображению.
+// В память изображения пишется только итог.
+inline void RunStencilTile(const std::vector<StencilStage>& stages, BlurRectFn blur3x3, const ImageView& src, const ImageView& dst,
+    const Tile& tile) {
+    int halo = StencilHalo(stages);
+    int bx0 = std::max(tile.x0 - halo, 0), by0 = std::max(tile.y0 - halo, 0);
+    int bx1 = std::min(tile.x1 + halo, src.width), by1 = std::min(tile.y1 + halo, src.height);
+    int bw = bx1 - bx0, bh = by1 - by0;
+    ptrdiff_t bstride = ptrdiff_t(bw) * 3;
+
+    thread_local std::vector<uint8_t> front, back;
+    front.resize(size_t(bstride) * bh);
+    back.resize(size_t(bstride) * bh);
+    for (int y = 0; y < bh; ++y) {
+        std::memcpy(front.data() + y * bstride, src.Row(by0 + y) + bx0 * 3, size_t(bstride));
+    }
+
+    int remaining = halo;
+    for (const StencilStage& stage : stages) {
+        remaining -= stage.Halo();
+        int x0 = std::max(tile.x0 - remaining, 0) - bx0, y0 = std::max(tile.y0 - remaining, 0) - by0;
+        int x1 = std::min(tile.x1 + remaining, src.width) - bx0, y1 = std::min(tile.y1 + remaining, src.height) - by0;
+        ApplyStencilStage(stage, blur3x3, front.data(), back.data(), bw, bh, bstride, x0, y0, x1, y1);
+        std::swap(front, back);
+    }
+
+    for (int y = tile.y0; y < tile.y1; ++y) {
+        std::memcpy(dst.Row(y) + tile.x0 * 3, front.data() + (y - by0) * bstride + (tile.x0 - bx0) * 3, size_t(tile.x1 - tile.x0) * 3);
+    }
+}
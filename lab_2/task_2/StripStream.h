@@ -0,0 +1,187 @@
+﻿#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "AsyncIO.h"
+#include "FileIO.h"
+#include "ImageView.h"
+#include "MappedBMP.h"
+
+struct StreamStats {
+    int bands = 0;
+    int bandRows = 0;
+    uint64_t bufferBytes = 0;
+    const char* backend = "sync";
+    double ioWaitSeconds = 0;   // основной поток ждал ввода-вывода
+    double blurSeconds = 0;
+};
+
+// Заголовки BMP и всё, что лежит до пикселей, для копирования в файл результата
+// (размер файла в заголовке пересчитан под пиксели без хвостовых данных)
+inline BMPLayout ReadBMPPrefix(const PositionalFile& in, std::vector<uint8_t>& prefix) {
+    uint64_t fileSize = in.Size();
+    if (fileSize < sizeof(BMPHeader) + sizeof(DIBHeader)) {
+        throw std::runtime_error("Not a valid BMP file.");
+    }
+    BMPHeader bmpHeader;
+    DIBHeader dibHeader;
+    in.ReadAt(&bmpHeader, sizeof(bmpHeader), 0);
+    in.ReadAt(&dibHeader, sizeof(dibHeader), sizeof(bmpHeader));
+    BMPLayout layout = ParseBMPLayout(bmpHeader, dibHeader, fileSize);
+
+    prefix.resize(layout.dataOffset);
+    in.ReadAt(prefix.data(), prefix.size(), 0);
+    uint64_t outSize = layout.dataOffset + layout.DataSize();
+    uint32_t outFileSize = outSize > UINT32_MAX ? 0 : static_cast<uint32_t>(outSize);
+    std::memcpy(prefix.data() + offsetof(BMPHeader, fileSize), &outFileSize, sizeof(outFileSize));
+    return layout;
+}
+
+// Потоковое размытие BMP, который не помещается в память. Изображение идёт полосами
+// строк: полоса читается вместе с ореолом в halo строк, blurBand(src, dst, y0, y1)
+// считает строки [y0, y1) окна полосы, результат сразу пишется в файл.
+// Буферы двух полос (источник и результат) не превышают memoryBudget байт.
+template <typename BlurBand>
+inline StreamStats StreamBlurBMP(const std::string& inputPath, const std::string& outputPath,
+    uint64_t memoryBudget, int halo, BlurBand blurBand) {
+    PositionalFile in = PositionalFile::OpenRead(inputPath);
+    std::vector<uint8_t> prefix;
+    BMPLayout layout = ReadBMPPrefix(in, prefix);
+    PositionalFile out = PositionalFile::Create(outputPath, layout.dataOffset + layout.DataSize());
+    out.WriteAt(prefix.data(), prefix.size(), 0);
+
+    uint64_t rowsFit = memoryBudget / (2 * layout.rowBytes);
+    if (rowsFit < uint64_t(2 * halo + 1)) {
+        throw std::runtime_error("Memory budget is too small for a single band.");
+    }
+
+    StreamStats stats;
+    stats.bandRows = int(std::min<uint64_t>(rowsFit - 2 * halo, uint64_t(layout.height)));
+    uint64_t bufferRows = std::min<uint64_t>(uint64_t(stats.bandRows) + 2 * halo, uint64_t(layout.height));
+    std::vector<uint8_t> srcBand(bufferRows * layout.rowBytes);
+    std::vector<uint8_t> dstBand(bufferRows * layout.rowBytes);
+    stats.bufferBytes = srcBand.size() + dstBand.size();
+
+    // Логические строки [first, last) занимают в файле один непрерывный участок
+    auto rangeOffset = [&](int first, int last) {
+        return layout.topDown ? layout.RowOffset(first) : layout.RowOffset(last - 1);
+    };
+
+    for (int y0 = 0; y0 < layout.height; y0 += stats.bandRows) {
+        int y1 = std::min(y0 + stats.bandRows, layout.height);
+        int r0 = std::max(y0 - halo, 0);
+        int r1 = std::min(y1 + halo, layout.height);
+
+        in.ReadAt(srcBand.data(), uint64_t(r1 - r0) * layout.rowBytes, rangeOffset(r0, r1));
+        ImageView src = layout.BufferView(srcBand.data(), r1 - r0);
+        ImageView dst = layout.BufferView(dstBand.data(), r1 - r0);
+        blurBand(src, dst, y0 - r0, y1 - r0);
+
+        const uint8_t* rows = layout.topDown ? dst.Row(y0 - r0) : dst.Row(y1 - 1 - r0);
+        out.WriteAt(rows, uint64_t(y1 - y0) * layout.rowBytes, rangeOffset(y0, y1));
+        ++stats.bands;
+    }
+    return stats;
+}
+
+// То же с перекрытием чтения, размытия и записи: depth полос в работе одновременно.
+// Чтения идут на depth полос вперёд; полоса размывается, как только прочитана она вместе
+// с ореолом, и сразу уходит на асинхронную запись. Буфер источника полосы освобождается
+// после размытия (туда читается полоса k + depth), буфер результата - после записи.
+// Время работы близко к max(ввод-вывод, размытие), а не к их сумме.
+template <typename BlurBand>
+inline StreamStats StreamBlurBMPPipelined(const std::string& inputPath, const std::string& outputPath,
+    uint64_t memoryBudget, int halo, AsyncIOBackend backend, int depth, BlurBand blurBand) {
+    PositionalFile in = PositionalFile::OpenRead(inputPath);
+    std::vector<uint8_t> prefix;
+    BMPLayout layout = ReadBMPPrefix(in, prefix);
+    PositionalFile out = PositionalFile::Create(outputPath, layout.dataOffset + layout.DataSize());
+    out.WriteAt(prefix.data(), prefix.size(), 0);
+
+    uint64_t rowsFit = memoryBudget / (2 * uint64_t(depth) * layout.rowBytes);
+    if (rowsFit < uint64_t(2 * halo + 1)) {
+        throw std::runtime_error("Memory budget is too small for the pipeline depth.");
+    }
+
+    StreamStats stats;
+    stats.bandRows = int(std::min<uint64_t>(rowsFit - 2 * halo, uint64_t(layout.height)));
+    const int bands = (layout.height + stats.bandRows - 1) / stats.bandRows;
+    depth = std::min(depth, bands);
+    uint64_t bufferRows = std::min<uint64_t>(uint64_t(stats.bandRows) + 2 * halo, uint64_t(layout.height));
+    std::vector<std::vector<uint8_t>> srcBands(depth), dstBands(depth);
+    for (int s = 0; s < depth; ++s) {
+        srcBands[s].resize(bufferRows * layout.rowBytes);
+        dstBands[s].resize(bufferRows * layout.rowBytes);
+        stats.bufferBytes += srcBands[s].size() + dstBands[s].size();
+    }
+
+    // Не больше depth чтений и depth записей одновременно
+    std::unique_ptr<AsyncIO> io = CreateAsyncIO(backend, unsigned(2 * depth));
+    stats.backend = io->Name();
+
+    auto rangeOffset = [&](int first, int last) {
+        return layout.topDown ? layout.RowOffset(first) : layout.RowOffset(last - 1);
+    };
+    auto bandRows = [&](int band, int& y0, int& y1, int& r0, int& r1) {
+        y0 = band * stats.bandRows;
+        y1 = std::min(y0 + stats.bandRows, layout.height);
+        r0 = std::max(y0 - halo, 0);
+        r1 = std::min(y1 + halo, layout.height);
+    };
+    // Метка запроса: номер полосы и вид (чтение - чётные, запись - нечётные)
+    auto submitRead = [&](int band) {
+        int y0, y1, r0, r1;
+        bandRows(band, y0, y1, r0, r1);
+        io->SubmitRead(in, srcBands[band % depth].data(), uint64_t(r1 - r0) * layout.rowBytes, rangeOffset(r0, r1), uint64_t(band) * 2);
+    };
+    std::vector<uint8_t> readDone(bands, 0), writeDone(bands, 0);
+    int writesPending = 0;
+    auto waitFor = [&](std::vector<uint8_t>& flags, int band) {
+        auto start = std::chrono::steady_clock::now();
+        while (!flags[band]) {
+            uint64_t tag = io->Wait();
+            (tag & 1 ? writeDone : readDone)[tag / 2] = 1;
+            writesPending -= int(tag & 1);
+        }
+        stats.ioWaitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    for (int band = 0; band < depth; ++band) {
+        submitRead(band);
+    }
+    for (int band = 0; band < bands; ++band) {
+        const int slot = band % depth;
+        int y0, y1, r0, r1;
+        bandRows(band, y0, y1, r0, r1);
+        waitFor(readDone, band);
+        if (band >= depth) {
+            waitFor(writeDone, band - depth);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        ImageView src = layout.BufferView(srcBands[slot].data(), r1 - r0);
+        ImageView dst = layout.BufferView(dstBands[slot].data(), r1 - r0);
+        blurBand(src, dst, y0 - r0, y1 - r0);
+        stats.blurSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (band + depth < bands) {
+            submitRead(band + depth);
+        }
+        const uint8_t* rows = layout.topDown ? dst.Row(y0 - r0) : dst.Row(y1 - 1 - r0);
+        io->SubmitWrite(out, rows, uint64_t(y1 - y0) * layout.rowBytes, rangeOffset(y0, y1), uint64_t(band) * 2 + 1);
+        ++writesPending;
+        ++stats.bands;
+    }
+    auto start = std::chrono::steady_clock::now();
+    while (writesPending > 0) {
+        io->Wait();
+        --writesPending;
+    }
+    stats.ioWaitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "ImageView.h"
+#include "ThreadPool.h"
+
+// Среднее и дисперсия каналов B, G, R в прямоугольнике
+struct RectStats {
+    double mean[3] = {};
+    double variance[3] = {};
+};
+
+// Таблица сумм по областям (интегральное изображение) для BGR24: элемент (x, y) - сумма
+// пикселей [0, x) x [0, y) по каждому каналу, размер (width + 1) x (height + 1).
+// Acc - тип накопителя; сумма всего изображения должна в него помещаться (см. SatFits32).
+// Квадраты (для дисперсии) копятся отдельно и всегда в 64 битах.
+template <typename Acc>
+class SummedAreaTable {
+public:
+    // Строит таблицу по строкам [y0, y1) окна src: сначала префиксные суммы каждой строки
+    // (строки параллельно), затем по столбцам (полосы столбцов параллельно, проход сверху вниз)
+    void Build(ThreadPool& pool, const ImageView& src, int y0, int y1, bool withSquares) {
+        width = src.width;
+        height = y1 - y0;
+        rowLen = size_t(width + 1) * 3;
+        sums.assign(rowLen * size_t(height + 1), 0);
+        squares.assign(withSquares ? sums.size() : 0, 0);
+
+        const unsigned jobs = pool.Size();
+        pool.Parallel(jobs, [&](unsigned job) {
+            for (int y = height * int(job) / int(jobs); y < height * int(job + 1) / int(jobs); ++y) {
+                const uint8_t* row = src.Row(y0 + y);
+                Acc* out = sums.data() + (y + 1) * rowLen;
+                uint64_t* outSq = withSquares ? squares.data() + (y + 1) * rowLen : nullptr;
+                for (size_t i = 0; i < size_t(width) * 3; ++i) {
+                    out[i + 3] = out[i] + row[i];
+                    if (outSq) {
+                        outSq[i + 3] = outSq[i] + uint64_t(row[i]) * row[i];
+                    }
+                }
+            }
+        });
+        pool.Parallel(jobs, [&](unsigned job) {
+            size_t i0 = rowLen * job / jobs, i1 = rowLen * (job + 1) / jobs;
+            for (int y = 2; y <= height; ++y) {
+                Acc* out = sums.data() + y * rowLen;
+                const Acc* prev = out - rowLen;
+                for (size_t i = i0; i < i1; ++i) {
+                    out[i] += prev[i];
+                }
+                if (withSquares) {
+                    uint64_t* outSq = squares.data() + y * rowLen;
+                    for (size_t i = i0; i < i1; ++i) {
+                        outSq[i] += outSq[i - rowLen];
+                    }
+                }
+            }
+        });
+    }
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+
+    // Сумма канала c по [x0, x1) x [y0, y1)
+    Acc Sum(int c, int x0, int y0, int x1, int y1) const {
+        return At(sums, x1, y1, c) - At(sums, x0, y1, c) - At(sums, x1, y0, c) + At(sums, x0, y0, c);
+    }
+
+    uint64_t SquareSum(int c, int x0, int y0, int x1, int y1) const {
+        return At(squares, x1, y1, c) - At(squares, x0, y1, c) - At(squares, x1, y0, c) + At(squares, x0, y0, c);
+    }
+
+    // Требует таблицы квадратов (withSquares)
+    RectStats Stats(int x0, int y0, int x1, int y1) const {
+        RectStats stats;
+        double n = double(x1 - x0) * double(y1 - y0);
+        if (n <= 0) {
+            return stats;
+        }
+        for (int c = 0; c < 3; ++c) {
+            stats.mean[c] = double(Sum(c, x0, y0, x1, y1)) / n;
+            stats.variance[c] = std::max(double(SquareSum(c, x0, y0, x1, y1)) / n - stats.mean[c] * stats.mean[c], 0.0);
+        }
+        return stats;
+    }
+
+    // Box-размытие окном (2 * radius + 1)^2 строк [y0, y1) таблицы в строки dstY0... окна dst:
+    // четыре обращения к таблице на канал при любом радиусе; окно обрезается по краям
+    // таблицы, результат побайтно совпадает с BoxBlurRect
+    void BoxBlur(ThreadPool& pool, const ImageView& dst, int dstY0, int y0, int y1, int radius) const {
+        const unsigned jobs = pool.Size();
+        pool.Parallel(jobs, [&](unsigned job) {
+            int r0 = y0 + (y1 - y0) * int(job) / int(jobs), r1 = y0 + (y1 - y0) * int(job + 1) / int(jobs);
+            for (int y = r0; y < r1; ++y) {
+                int wy0 = std::max(y - radius, 0), wy1 = std::min(y + radius + 1, height);
+                uint8_t* out = dst.Row(dstY0 + y - y0);
+                for (int x = 0; x < width; ++x) {
+                    int wx0 = std::max(x - radius, 0), wx1 = std::min(x + radius + 1, width);
+                    Acc count = Acc(wx1 - wx0) * Acc(wy1 - wy0);
+                    for (int c = 0; c < 3; ++c) {
+                        out[x * 3 + c] = static_cast<uint8_t>(Sum(c, wx0, wy0, wx1, wy1) / count);
+                    }
+                }
+            }
+        });
+    }
+
+private:
+    int width = 0;
+    int height = 0;
+    size_t rowLen = 0;
+    std::vector<Acc> sums;
+    std::vector<uint64_t> squares;
+
+    template <typename T>
+    T At(const std::vector<T>& table, int x, int y, int c) const {
+        return table[size_t(y) * rowLen + size_t(x) * 3 + c];
+    }
+};
+
+// Хватает ли 32-битного накопителя: сумма канала по всему изображению < 2^32
+inline bool SatFits32(int width, int height) {
+    return uint64_t(width) * uint64_t(height) * 255 <= UINT32_MAX;
+}
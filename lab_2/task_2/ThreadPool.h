@@ -0,0 +1,89 @@
+﻿#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <latch>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Постоянный пул потоков: потоки создаются один раз на процесс
+// и обслуживают все изображения, полосы и стадии.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned numThreads) {
+        for (unsigned i = 0; i < std::max(numThreads, 1u); ++i) {
+            workers.emplace_back([this] { WorkerLoop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+    }
+
+    unsigned Size() const { return static_cast<unsigned>(workers.size()); }
+
+    void Submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            tasks.push(std::move(task));
+        }
+        cv.notify_one();
+    }
+
+    // fn(i) для i из [0, count) на потоках пула; возврат после завершения всех вызовов.
+    // Исключение из fn не выходит за поток пула: первое из них повторно бросается
+    // здесь, после завершения остальных вызовов. Вызывать не из потока этого же пула.
+    template <typename Fn>
+    void Parallel(unsigned count, Fn fn) {
+        std::latch done(count);
+        std::mutex errorMtx;
+        std::exception_ptr error;
+        for (unsigned i = 0; i < count; ++i) {
+            Submit([&fn, &done, &errorMtx, &error, i] {
+                try {
+                    fn(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(errorMtx);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
+                done.count_down();
+            });
+        }
+        done.wait();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::queue<std::function<void()>> tasks;
+    bool stopping = false;
+    std::vector<std::jthread> workers;
+
+    void WorkerLoop() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+};
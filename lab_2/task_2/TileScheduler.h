@@ -0,0 +1,333 @@
+﻿#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "ThreadPool.h"
+
+struct Tile {
+    int x0, y0, x1, y1;
+    int id;
+};
+
+// Morton и Hilbert - кривые, заполняющие плоскость: соседние по номеру плитки соседствуют
+// и на изображении, поэтому непрерывный участок списка у потока - компактная область,
+// а не длинная полоса, и строки ореола соседних плиток ещё в кэше.
+enum class TileOrder {
+    Row,
+    Column,
+    Serpentine,
+    Morton,
+    Hilbert
+};
+
+inline const char* TileOrderName(TileOrder order) {
+    switch (order) {
+    case TileOrder::Column: return "column";
+    case TileOrder::Serpentine: return "serpentine";
+    case TileOrder::Morton: return "morton";
+    case TileOrder::Hilbert: return "hilbert";
+    default: return "row";
+    }
+}
+
+constexpr TileOrder kAllTileOrders[] = { TileOrder::Row, TileOrder::Column, TileOrder::Serpentine, TileOrder::Morton, TileOrder::Hilbert };
+
+inline bool ParseTileOrder(const std::string& name, TileOrder& order) {
+    for (TileOrder o : kAllTileOrders) {
+        if (name == TileOrderName(o)) {
+            order = o;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Номер клетки (x, y) на кривой Мортона (Z-порядок): чередование битов x и y
+inline uint64_t MortonIndex(uint32_t x, uint32_t y) {
+    auto spread = [](uint64_t v) {
+        v &= 0xFFFFFFFF;
+        v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+        v = (v | (v << 8)) & 0x00FF00FF00FF00FFull;
+        v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0Full;
+        v = (v | (v << 2)) & 0x3333333333333333ull;
+        v = (v | (v << 1)) & 0x5555555555555555ull;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1);
+}
+
+// Номер клетки (x, y) на кривой Гильберта в квадрате side x side (side - степень двойки)
+inline uint64_t HilbertIndex(uint32_t side, uint32_t x, uint32_t y) {
+    uint64_t d = 0;
+    for (uint32_t s = side / 2; s > 0; s /= 2) {
+        uint32_t rx = (x & s) ? 1 : 0;
+        uint32_t ry = (y & s) ? 1 : 0;
+        d += uint64_t(s) * s * ((3 * rx) ^ ry);
+        // Поворот четверти, чтобы следующий уровень шёл в той же ориентации
+        if (ry == 0) {
+            if (rx == 1) {
+                x = side - 1 - x;
+                y = side - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+// Порядок обхода сетки tilesX x tilesY: клетки (tx, ty) в порядке order. Кривые строятся
+// в квадрате со стороной - степенью двойки, клетки вне сетки пропускаются.
+inline std::vector<std::pair<int, int>> TraversalOrder(int tilesX, int tilesY, TileOrder order) {
+    std::vector<std::pair<int, int>> cells;
+    cells.reserve(size_t(tilesX) * tilesY);
+    switch (order) {
+    case TileOrder::Column:
+        for (int tx = 0; tx < tilesX; ++tx) {
+            for (int ty = 0; ty < tilesY; ++ty) {
+                cells.emplace_back(tx, ty);
+            }
+        }
+        break;
+    case TileOrder::Serpentine:
+        for (int ty = 0; ty < tilesY; ++ty) {
+            for (int i = 0; i < tilesX; ++i) {
+                cells.emplace_back(ty % 2 == 0 ? i : tilesX - 1 - i, ty);
+            }
+        }
+        break;
+    case TileOrder::Morton:
+    case TileOrder::Hilbert: {
+        uint32_t side = 1;
+        while (side < uint32_t(std::max(tilesX, tilesY))) {
+            side *= 2;
+        }
+        std::vector<std::pair<uint64_t, std::pair<int, int>>> keyed;
+        keyed.reserve(size_t(tilesX) * tilesY);
+        for (int ty = 0; ty < tilesY; ++ty) {
+            for (int tx = 0; tx < tilesX; ++tx) {
+                uint64_t key = order == TileOrder::Morton ? MortonIndex(tx, ty) : HilbertIndex(side, tx, ty);
+                keyed.push_back({ key, { tx, ty } });
+            }
+        }
+        std::sort(keyed.begin(), keyed.end());
+        for (const auto& k : keyed) {
+            cells.push_back(k.second);
+        }
+        break;
+    }
+    default:
+        for (int ty = 0; ty < tilesY; ++ty) {
+            for (int tx = 0; tx < tilesX; ++tx) {
+                cells.emplace_back(tx, ty);
+            }
+        }
+        break;
+    }
+    return cells;
+}
+
+// Разбиение на плитки: столбцы между соседними границами xs (xs[0] = 0, последняя - ширина),
+// строки высотой tileH, включая неполные плитки у нижнего края.
+// id плитки - её номер в построчном порядке, независимо от порядка обхода.
+inline std::vector<Tile> MakeTilesAt(const std::vector<int>& xs, int height, int tileH, TileOrder order) {
+    int tilesX = int(xs.size()) - 1;
+    int tilesY = (height + tileH - 1) / tileH;
+    std::vector<Tile> tiles;
+    tiles.reserve(size_t(tilesX) * tilesY);
+    auto add = [&](int tx, int ty) {
+        tiles.push_back(Tile{ xs[tx], ty * tileH, xs[tx + 1], std::min((ty + 1) * tileH, height), ty * tilesX + tx });
+    };
+
+    for (auto [tx, ty] : TraversalOrder(tilesX, tilesY, order)) {
+        add(tx, ty);
+    }
+    return tiles;
+}
+
+// Разбиение на плитки tileW x tileH, включая неполные плитки у правого и нижнего края
+inline std::vector<Tile> MakeTiles(int width, int height, int tileW, int tileH, TileOrder order) {
+    std::vector<int> xs;
+    for (int x = 0; x < width; x += tileW) {
+        xs.push_back(x);
+    }
+    xs.push_back(width);
+    return MakeTilesAt(xs, height, tileH, order);
+}
+
+// Как делить изображение между потоками:
+// grid  - плитки tileW x tileH как есть (соседние плитки делят строки кэша в dst);
+// tiles - ширина плиток кратна 64 пикселям, границы по x - на границах 64-байтных строк кэша;
+// rows  - полосы во всю ширину по tileH строк, строки кэша делят только края полос;
+// auto  - при построчном порядке обхода rows, если полос хватает на 4 на поток или шаг строк
+//         не кратен 64 (тогда границы tiles выровнены не во всех строках, а полосы делаются
+//         тоньше tileH, чтобы их хватило на все потоки), иначе tiles (у полос во всю ширину
+//         порядок обхода один - сверху вниз).
+enum class TilePartition {
+    Grid,
+    Tiles,
+    Rows,
+    Auto
+};
+
+inline const char* TilePartitionName(TilePartition partition) {
+    switch (partition) {
+    case TilePartition::Grid: return "grid";
+    case TilePartition::Tiles: return "tiles";
+    case TilePartition::Rows: return "rows";
+    default: return "auto";
+    }
+}
+
+inline bool ParseTilePartition(const std::string& name, TilePartition& partition) {
+    for (TilePartition p : { TilePartition::Grid, TilePartition::Tiles, TilePartition::Rows, TilePartition::Auto }) {
+        if (name == TilePartitionName(p)) {
+            partition = p;
+            return true;
+        }
+    }
+    return false;
+}
+
+constexpr int kCacheLine = 64;
+
+// Границы столбцов плиток по строке row0 результата (pixelBytes байт на пиксель): столбцы
+// шириной tileW, округлённой вверх до кратной строке кэша в байтах, первая граница - там,
+// где пиксель начинает строку кэша. Выравнивание точное только в строке row0 и в строках,
+// отстоящих от неё на кратное 64 байтам смещение: при шаге строк, кратном 64 (PixelBuffer,
+// плоскости плоского режима), - во всех. У BMP шаг кратен лишь 4, и в остальных строках
+// соседние плитки снова могут делить по строке кэша на каждой границе - поэтому auto
+// при таком шаге выбирает rows.
+inline std::vector<int> CacheAlignedColumns(int width, int tileW, const uint8_t* row0, int pixelBytes) {
+    // Пикселей в периоде: наименьшее n, при котором n * pixelBytes кратно 64
+    int period = 1;
+    while (period * pixelBytes % kCacheLine != 0) {
+        ++period;
+    }
+    const int columnW = (std::max(tileW, 1) + period - 1) / period * period;
+    // Первый пиксель x, с которого начинается строка кэша: (row0 + x * pixelBytes) % 64 == 0
+    const int misalign = int(reinterpret_cast<uintptr_t>(row0) % kCacheLine);
+    int first = 0;
+    while (first < period && (misalign + first * pixelBytes) % kCacheLine != 0) {
+        ++first;
+    }
+    std::vector<int> xs{ 0 };
+    for (int x = first == period ? columnW : first; x < width; x += columnW) {
+        if (x > 0) {
+            xs.push_back(x);
+        }
+    }
+    xs.push_back(width);
+    return xs;
+}
+
+// Плитки строк [0, height) окна результата, первая строка которого - row0, шаг строк - stride
+inline std::vector<Tile> PlanTiles(TilePartition partition, const uint8_t* row0, ptrdiff_t stride, int pixelBytes,
+    int width, int height, int tileW, int tileH, TileOrder order, unsigned workers) {
+    const int minBands = 4 * int(std::max(workers, 1u));
+    int bandH = tileH;
+    if (partition == TilePartition::Auto) {
+        bool enoughBands = (height + tileH - 1) / tileH >= minBands;
+        bool alignedRows = stride % kCacheLine == 0;
+        partition = order == TileOrder::Row && (enoughBands || !alignedRows) ? TilePartition::Rows : TilePartition::Tiles;
+        if (!enoughBands) {
+            bandH = std::max((height + minBands - 1) / minBands, 1);
+        }
+    }
+    switch (partition) {
+    case TilePartition::Rows:
+        return MakeTilesAt({ 0, width }, height, bandH, TileOrder::Row);
+    case TilePartition::Tiles:
+        return MakeTilesAt(CacheAlignedColumns(width, tileW, row0, pixelBytes), height, tileH, order);
+    default:
+        return MakeTiles(width, height, tileW, tileH, order);
+    }
+}
+
+// Очередь плиток одного потока: владелец берёт с начала (порядок обхода сохраняется),
+// другие потоки крадут с конца, то есть самую дальнюю от владельца работу.
+class TileDeque {
+public:
+    void Push(const Tile& tile) {
+        std::lock_guard<std::mutex> lock(mtx);
+        tiles.push_back(tile);
+    }
+
+    bool Pop(Tile& tile) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (tiles.empty()) {
+            return false;
+        }
+        tile = tiles.front();
+        tiles.pop_front();
+        return true;
+    }
+
+    bool Steal(Tile& tile) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (tiles.empty()) {
+            return false;
+        }
+        tile = tiles.back();
+        tiles.pop_back();
+        return true;
+    }
+
+private:
+    std::mutex mtx;
+    std::deque<Tile> tiles;
+};
+
+// Планировщик с кражей работы: каждый поток получает непрерывный участок списка
+// плиток, а закончив свой, забирает плитки у соседей. Обрабатываются все плитки.
+class TileScheduler {
+public:
+    TileScheduler(const std::vector<Tile>& tiles, unsigned numWorkers)
+        : queues(std::max(numWorkers, 1u))
+    {
+        size_t workers = queues.size();
+        for (size_t w = 0; w < workers; ++w) {
+            size_t begin = tiles.size() * w / workers;
+            size_t end = tiles.size() * (w + 1) / workers;
+            for (size_t i = begin; i < end; ++i) {
+                queues[w].Push(tiles[i]);
+            }
+        }
+    }
+
+    unsigned WorkerCount() const { return static_cast<unsigned>(queues.size()); }
+    unsigned StolenCount() const { return stolen.load(); }
+
+    bool Next(unsigned worker, Tile& tile) {
+        if (queues[worker].Pop(tile)) {
+            return true;
+        }
+        for (size_t i = 1; i < queues.size(); ++i) {
+            if (queues[(worker + i) % queues.size()].Steal(tile)) {
+                ++stolen;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // fn(worker, tile) вызывается для каждой плитки ровно один раз; возврат после обработки всех плиток
+    template <typename Fn>
+    void Run(ThreadPool& pool, Fn fn) {
+        pool.Parallel(WorkerCount(), [this, &fn](unsigned w) {
+            Tile tile;
+            while (Next(w, tile)) {
+                fn(w, tile);
+            }
+        });
+    }
+
+private:
+    std::vector<TileDeque> queues;
+    std::atomic<unsigned> stolen{ 0 };
+};
@@ -5,127 +5,876 @@
 #include <mutex>
 #include <cmath>
 #include <cstring>
+#include <chrono>
+#include <string>
+#include <memory>
+#include "BMPUtils.h"
+#include "BoxBlur.h"
+#include "GaussianBlur.h"
+#include "PlanarImage.h"
+#include "StencilPipeline.h"
+#include "SummedAreaTable.h"
+#include "MedianFilter.h"
+#include "FftConvolve.h"
+#include "RoiBlur.h"
+#include "IncrementalBlur.h"
+#include "Pyramid.h"
+#include "Resample.h"
+#include "SimdBlur.h"
+#include "TileScheduler.h"
+#include "MappedBMP.h"
+#include "StripStream.h"
+#include "ThreadPool.h"
+#include "BatchPipeline.h"
 
-// Структуры для хранения BMP заголовков
-#pragma pack(push, 1)
-struct BMPHeader {
-    uint16_t fileType;      // Тип файла (BM)
-    uint32_t fileSize;      // Размер файла в байтах
-    uint16_t reserved1;     // Зарезервировано
-    uint16_t reserved2;     // Зарезервировано
-    uint32_t offsetData;    // Смещение до начала данных изображения
+std::mutex mtx; 
+BlurRectFn blurKernel = BlurRect3x3Scalar;
+
+enum class FilterType {
+    Box,
+    Gauss,
+    Sat,    // box любого радиуса через таблицу сумм по областям
+    Median,
+    Conv    // произвольное ядро из файла: прямо или через БПФ
 };
 
-struct DIBHeader {
-    uint32_t size;          // Размер DIB заголовка
-    int32_t width;          // Ширина изображения
-    int32_t height;         // Высота изображения
-    uint16_t planes;        // Количество цветовых плоскостей
-    uint16_t bitCount;      // Количество бит на пиксель
-    uint32_t compression;    // Метод сжатия
-    uint32_t sizeImage;     // Размер изображения
-    int32_t xPelsPerMeter;   // Горизонтальное разрешение
-    int32_t yPelsPerMeter;   // Вертикальное разрешение
-    uint32_t colorsUsed;     // Количество используемых цветов
-    uint32_t colorsImportant; // Количество важных цветов
+// Гаусс с радиусом не больше этого считается прямой свёрткой, больше - тремя box-проходами.
+// Края в обоих случаях продолжаются крайними пикселями. --radius - полуширина ядра, без
+// --sigma sigma = radius / 2; если --sigma задана, у box-проходов полуширину задаёт
+// sigma (около 3 sigma), а --radius только выбирает способ.
+constexpr int kDirectGaussMaxRadius = 7;
+
+struct FilterPlan {
+    FilterType type = FilterType::Box;
+    int radius = 1;
+    std::vector<uint16_t> taps;   // прямой гаусс
+    std::vector<int> boxPasses;   // расширенный box: радиусы последовательных проходов
+    ConvKernel conv;
+    std::shared_ptr<FftConvolver> fft;   // пусто - свёртка напрямую
+
+    // Сколько строк за пределами полосы нужно прочитать для её размытия
+    int Halo() const {
+        if (type == FilterType::Conv) {
+            return conv.Halo();
+        }
+        int halo = 0;
+        for (int r : boxPasses) {
+            halo += r;
+        }
+        return boxPasses.empty() ? radius : halo;
+    }
 };
-#pragma pack(pop)
 
-std::mutex mtx; 
+void blurImage(const ImageView& src, const ImageView& dst, const Tile& tile, const FilterPlan& filter) {
+    if (filter.type == FilterType::Gauss) {
+        GaussianBlurRectN<3>(src.data, dst.data, src.width, src.height, src.stride, tile.x0, tile.y0, tile.x1, tile.y1, filter.taps);
+    } else if (filter.type == FilterType::Median) {
+        MedianFilterRect<3>(src.data, dst.data, src.width, src.height, src.stride, tile.x0, tile.y0, tile.x1, tile.y1, filter.radius);
+    } else if (filter.radius == 1) {
+        blurKernel(src.data, dst.data, src.width, src.height, src.stride, tile.x0, tile.y0, tile.x1, tile.y1);
+    } else {
+        BoxBlurRect(src.data, dst.data, src.width, src.height, src.stride, tile.x0, tile.y0, tile.x1, tile.y1, filter.radius);
+    }
+}
+
+// То же для одной плоскости (канала)
+void blurPlane(const PlaneView& src, const PlaneView& dst, const Tile& tile, const FilterPlan& filter) {
+    if (filter.type == FilterType::Gauss) {
+        GaussianBlurRectN<1>(src.data, dst.data, src.width, src.height, src.stride, tile.x0, tile.y0, tile.x1, tile.y1, filter.taps);
+    } else if (filter.type == FilterType::Median) {
+        MedianFilterRect<1>(src.data, dst.data, src.width, src.height, src.stride, tile.x0, tile.y0, tile.x1, tile.y1, filter.radius);
+    } else {
+        BoxBlurRectN<1>(src.data, dst.data, src.width, src.height, src.stride, tile.x0, tile.y0, tile.x1, tile.y1, filter.radius);
+    }
+}
+
+struct Options {
+    std::vector<std::string> positional;
+    BlurKernel kernel = DetectBestBlurKernel();
+    int tileW = 16;
+    int tileH = 16;
+    TileOrder order = TileOrder::Row;
+    TilePartition partition = TilePartition::Auto;
+    bool stream = false;
+    uint64_t memoryBudget = uint64_t(256) << 20;
+    bool pipelined = false;   // потоковый режим с асинхронным чтением и записью
+    AsyncIOBackend io = AsyncIOBackend::Auto;
+    bool batch = false;
+    int batchDepth = 4;
+    FilterType filterType = FilterType::Box;
+    int radius = 1;
+    double sigma = 0;
+    bool planar = false;
+    FilterPlan filter;
+    std::string regions;
+    std::string roi;
+    std::string edits;
+    bool preview = false;
+    bool progressive = false;
+    int previewLevel = -1;   // -1 - по kPreviewPixels
+    int resizeW = 0;         // 0 - без изменения размера
+    int resizeH = 0;
+    ResampleFilter resample = ResampleFilter::Lanczos3;
+    std::string convPath;
+    std::string convMode = "auto";
+    std::vector<StencilStage> pipeline;
+    bool unfused = false;
+    int iterations = 1;
+    int timeBlock = 0;   // этапов на один проход плиток; 0 - подобрать по размеру плитки
+    unsigned squares = 0;      // > 0 - детерминированное размытие случайных квадратов (BMPImage)
+    unsigned squareSize = 32;
+    uint32_t seed = 0;
 
-void blurImage(const uint8_t* src, uint8_t* dst, int width, int height, int startX, int startY, int blockSize) {
-    int endX = std::min(startX + blockSize, width);
-    int endY = std::min(startY + blockSize, height);
-    for (int y = startY; y < endY; ++y) {
-        for (int x = startX; x < endX; ++x) {
-            int sumR = 0, sumG = 0, sumB = 0;
-            int count = 0;
-            for (int dy = -1; dy <= 1; ++dy) {
-                for (int dx = -1; dx <= 1; ++dx) {
-                    int nx = x + dx;
-                    int ny = y + dy;
-                    if (nx >= 0 && nx < width && ny >= 0 && ny < height) {
-                        sumB += src[(ny * width + nx) * 3];
-                        sumG += src[(ny * width + nx) * 3 + 1];
-                        sumR += src[(ny * width + nx) * 3 + 2];
-                        count++;
-                    }
+};
+
+FilterPlan makeFilterPlan(const Options& options) {
+    FilterPlan plan;
+    plan.type = options.filterType;
+    plan.radius = options.radius;
+    if (plan.type == FilterType::Conv) {
+        plan.conv = LoadConvKernel(options.convPath);
+        bool useFft = options.convMode == "fft" || (options.convMode == "auto" && PreferFftConvolution(plan.conv));
+        int blockSize = useFft ? FftConvolver::ChooseBlockSize(plan.conv) : 0;
+        if (useFft && blockSize == 0) {
+            std::cerr << "Kernel is too large for an FFT block of " << FftConvolver::kMaxBlockSize
+                << ", using direct convolution." << std::endl;
+        } else if (useFft) {
+            plan.fft = std::make_shared<FftConvolver>(plan.conv, blockSize);
+        }
+    }
+    if (plan.type == FilterType::Gauss) {
+        double sigma = options.sigma > 0 ? options.sigma : std::max(options.radius / 2.0, 0.5);
+        if (options.radius <= kDirectGaussMaxRadius) {
+            plan.taps = MakeGaussianTaps(options.radius, sigma);
+        } else {
+            plan.boxPasses = BoxRadiiForGauss(sigma, 3);
+        }
+    }
+    return plan;
+}
+
+// fn(tile) для плиток строк [y0, y1) окна dst на потоках пула, разбиение - по options.partition;
+// возвращает число украденных плиток
+template <typename Fn>
+unsigned runTiles(ThreadPool& pool, const ImageView& dst, int y0, int y1, const Options& options, Fn fn) {
+    std::vector<Tile> tiles = PlanTiles(options.partition, dst.Row(y0), dst.stride, 3, dst.width, y1 - y0,
+        options.tileW, options.tileH, options.order, pool.Size());
+    for (Tile& tile : tiles) {
+        tile.y0 += y0;
+        tile.y1 += y0;
+    }
+    TileScheduler scheduler(tiles, pool.Size());
+    scheduler.Run(pool, [&](unsigned, const Tile& tile) {
+        fn(tile);
+    });
+    return scheduler.StolenCount();
+}
+
+// Плоский режим: строки с ореолом раскладываются по плоскостям B, G, R (PixelBuffer в
+// PixelLayout::Planar), каждая плоскость размывается своими плитками (плитки всех трёх
+// плоскостей - общий набор задач пула). Строка y из [y0, y1) результата - строка y - outY0 out.
+unsigned blurPlanes(ThreadPool& pool, const ImageView& src, int y0, int y1, const Options& options, PixelBuffer& out, int& outY0) {
+    const FilterPlan& filter = options.filter;
+    int halo = filter.Halo();
+    int py0 = std::max(y0 - halo, 0), py1 = std::min(y1 + halo, src.height);
+    int rows = py1 - py0;
+    PixelBuffer in(src.width, rows, PixelLayout::Planar);
+    out = PixelBuffer(src.width, rows, PixelLayout::Planar);
+    outY0 = py0;
+
+    const unsigned chunks = pool.Size();
+    pool.Parallel(chunks, [&](unsigned i) {
+        UnpackRows(src, py0 + rows * i / chunks, py0 + rows * (i + 1) / chunks, in, rows * i / chunks);
+    });
+
+    // Плитки строк [ly0, ly1) плоскостей target, по копии на канал; канал - по id плитки
+    auto runPlanes = [&](const PixelBuffer& target, int ly0, int ly1, auto fn) {
+        std::vector<Tile> tiles = PlanTiles(options.partition, target.Plane(0).Row(ly0), target.Plane(0).stride, 1, target.Width(), ly1 - ly0,
+            options.tileW, options.tileH, options.order, pool.Size());
+        const int perPlane = int(tiles.size());
+        std::vector<Tile> all;
+        all.reserve(tiles.size() * 3);
+        for (int c = 0; c < 3; ++c) {
+            for (Tile tile : tiles) {
+                tile.y0 += ly0;
+                tile.y1 += ly0;
+                tile.id += c * perPlane;
+                all.push_back(tile);
+            }
+        }
+        TileScheduler scheduler(all, pool.Size());
+        scheduler.Run(pool, [&](unsigned, const Tile& tile) {
+            fn(tile.id / perPlane, tile);
+        });
+        return scheduler.StolenCount();
+    };
+
+    unsigned stolen = 0;
+    if (filter.boxPasses.empty()) {
+        stolen = runPlanes(out, y0 - py0, y1 - py0, [&](int c, const Tile& tile) {
+            blurPlane(in.Plane(c), out.Plane(c), tile, filter);
+        });
+    } else {
+        // Как в blurRows: проходы по копиям плоскостей с полями в ореол, продолженными краями
+        const int paddedRows = y1 - y0 + 2 * halo;
+        PixelBuffer padded[2] = { PixelBuffer(src.width + 2 * halo, paddedRows, PixelLayout::Planar),
+            PixelBuffer(src.width + 2 * halo, paddedRows, PixelLayout::Planar) };
+        pool.Parallel(chunks, [&](unsigned i) {
+            for (int r = paddedRows * int(i) / int(chunks); r < paddedRows * int(i + 1) / int(chunks); ++r) {
+                int from = std::clamp(y0 - halo + r, 0, src.height - 1) - py0;
+                for (int c = 0; c < 3; ++c) {
+                    PadRowReplicate<1>(in.Plane(c).Row(from), src.width, halo, padded[0].Plane(c).Row(r));
                 }
             }
-            dst[(y * width + x) * 3] = sumB / count;
-            dst[(y * width + x) * 3 + 1] = sumG / count;
-            dst[(y * width + x) * 3 + 2] = sumR / count;
+        });
+        int remaining = halo;
+        int current = 0;
+        for (int radius : filter.boxPasses) {
+            remaining -= radius;
+            const PixelBuffer& passIn = padded[current];
+            const PixelBuffer& passOut = padded[1 - current];
+            stolen += runPlanes(passOut, halo - remaining, paddedRows - halo + remaining, [&](int c, const Tile& tile) {
+                PlaneView s = passIn.Plane(c), d = passOut.Plane(c);
+                BoxBlurRectN<1>(s.data, d.data, s.width, s.height, s.stride, tile.x0, tile.y0, tile.x1, tile.y1, radius);
+            });
+            current = 1 - current;
         }
+        pool.Parallel(chunks, [&](unsigned i) {
+            for (int y = y0 + (y1 - y0) * int(i) / int(chunks); y < y0 + (y1 - y0) * int(i + 1) / int(chunks); ++y) {
+                for (int c = 0; c < 3; ++c) {
+                    std::memcpy(out.Plane(c).Row(y - py0), padded[current].Plane(c).Row(y - y0 + halo) + halo, size_t(src.width));
+                }
+            }
+        });
     }
+    return stolen;
+}
+
+// Плоский режим для окна: размытие в плоскостях и сборка строк [y0, y1) обратно в dst
+unsigned blurRowsPlanar(ThreadPool& pool, const ImageView& src, const ImageView& dst, int y0, int y1, const Options& options) {
+    PixelBuffer out;
+    int outY0 = 0;
+    unsigned stolen = blurPlanes(pool, src, y0, y1, options, out, outY0);
+    const unsigned chunks = pool.Size();
+    pool.Parallel(chunks, [&](unsigned i) {
+        int r0 = (y1 - y0) * i / chunks, r1 = (y1 - y0) * (i + 1) / chunks;
+        PackRows(out, y0 - outY0 + r0, y0 - outY0 + r1, dst, y0 + r0);
+    });
+    return stolen;
 }
 
-void processBlocks(const uint8_t* src, uint8_t* dst, int width, int height, int blockSize, int blocksPerThread, int threadID) {
-    for (int i = 0; i < blocksPerThread; ++i) {
-        int blockX = (threadID * blocksPerThread + i) % (width / blockSize) * blockSize;
-        int blockY = (threadID * blocksPerThread + i) / (width / blockSize) * blockSize;
-        if (blockY < height) {
-            blurImage(src, dst, width, height, blockX, blockY, blockSize);
-        } 
+// Гистограммы столбцов медианы заводятся заново в каждой плитке, поэтому ей - полосы
+// во всю высоту строк [y0, y1) и шириной не меньше 64 и 4 радиусов
+Options medianStrips(const Options& options, int y0, int y1) {
+    Options strips = options;
+    strips.tileW = std::max({ options.tileW, 64, 4 * options.filter.radius });
+    strips.tileH = std::max(y1 - y0, 1);
+    if (strips.partition != TilePartition::Grid) {
+        strips.partition = TilePartition::Tiles;
     }
+    return strips;
 }
 
-int main(int argc, char* argv[]) 
-{
-    if (argc < 4) {
-        std::cerr << "Usage: " << argv[0] << " <input.bmp> <output.bmp> <num_threads>" << std::endl;
+// Плоский режим работает с фильтрами, которые считают каналы независимо
+bool supportsPlanar(const Options& options) {
+    return options.pipeline.empty() && options.filterType != FilterType::Conv;
+}
+
+// Ореол строк для полосы: у конвейера этапов - сумма ореолов этапов
+int rowHalo(const Options& options) {
+    return options.pipeline.empty() ? options.filter.Halo() : StencilHalo(options.pipeline);
+}
+
+// Этапов в одном слитном проходе: ореол группы не больше четверти плитки,
+// иначе повторный счёт перекрытий съедает выигрыш от кэша
+int pipelineTimeBlock(const Options& options) {
+    if (options.unfused) {
         return 1;
     }
+    if (options.timeBlock > 0) {
+        return options.timeBlock;
+    }
+    int maxHalo = 1;
+    for (const StencilStage& stage : options.pipeline) {
+        maxHalo = std::max(maxHalo, stage.Halo());
+    }
+    return std::max(std::min(options.tileW, options.tileH) / (4 * maxHalo), 1);
+}
 
-    const char* inputFilename = argv[1];
-    const char* outputFilename = argv[2];
-    int numThreads = std::stoi(argv[3]);
+// Конвейер этапов группами по pipelineTimeBlock этапов (временные блоки): каждая плитка
+// проходит все этапы группы в своём буфере с ореолом оставшихся этапов группы, между
+// группами - промежуточные изображения. Группа считает строки с запасом на ореол
+// следующих групп. С --unfused группа - один этап, то есть обычные проходы подряд.
+unsigned runPipelineRows(ThreadPool& pool, const ImageView& src, const ImageView& dst, int y0, int y1, const Options& options) {
+    const std::vector<StencilStage>& stages = options.pipeline;
+    const size_t block = size_t(pipelineTimeBlock(options));
+    if (block >= stages.size()) {
+        return runTiles(pool, dst, y0, y1, options, [&](const Tile& tile) {
+            RunStencilTile(stages, blurKernel, src, dst, tile);
+        });
+    }
 
-    std::ifstream inputFile(inputFilename, std::ios::binary);
-    if (!inputFile) 
-    {
-        std::cerr << "Error opening input file." << std::endl;
-        return 1;
+    std::vector<uint8_t> storageA, storageB;
+    ImageView bufA = AllocateLike(src, storageA), bufB = AllocateLike(src, storageB);
+    int remaining = StencilHalo(stages);
+    const ImageView* in = &src;
+    unsigned stolen = 0;
+    for (size_t first = 0, group = 0; first < stages.size(); first += block, ++group) {
+        std::vector<StencilStage> groupStages(stages.begin() + first, stages.begin() + std::min(first + block, stages.size()));
+        remaining -= StencilHalo(groupStages);
+        const ImageView* out = first + block >= stages.size() ? &dst : (group % 2 == 0 ? &bufA : &bufB);
+        stolen += runTiles(pool, *out, std::max(y0 - remaining, 0), std::min(y1 + remaining, src.height), options,
+            [&](const Tile& tile) {
+                RunStencilTile(groupStages, blurKernel, *in, *out, tile);
+            });
+        in = out;
+    }
+    return stolen;
+}
+
+// Box через таблицу сумм строк полосы с ореолом; накопитель 32 или 64 бита по размеру полосы
+unsigned blurRowsSat(ThreadPool& pool, const ImageView& src, const ImageView& dst, int y0, int y1, const Options& options) {
+    int radius = options.filter.radius;
+    int py0 = std::max(y0 - radius, 0), py1 = std::min(y1 + radius, src.height);
+    auto run = [&](auto table) {
+        table.Build(pool, src, py0, py1, false);
+        table.BoxBlur(pool, dst, y0, y0 - py0, y1 - py0, radius);
+    };
+    if (SatFits32(src.width, py1 - py0)) {
+        run(SummedAreaTable<uint32_t>());
+    } else {
+        run(SummedAreaTable<uint64_t>());
+    }
+    return 0;
+}
+
+// Среднее и дисперсия прямоугольников из файла (строки "x0 y0 x1 y1", границы полуоткрытые)
+void printRegionStats(ThreadPool& pool, const ImageView& src, const std::string& path) {
+    std::ifstream list(path);
+    if (!list) {
+        throw std::runtime_error("Could not open regions file: " + path);
+    }
+    // Накопитель сумм - как в blurRowsSat: 32 бита, если сумма канала по изображению в них помещается
+    auto run = [&](auto table) {
+        table.Build(pool, src, 0, src.height, true);
+        int x0, y0, x1, y1;
+        while (list >> x0 >> y0 >> x1 >> y1) {
+            x0 = std::clamp(x0, 0, src.width);
+            x1 = std::clamp(x1, x0, src.width);
+            y0 = std::clamp(y0, 0, src.height);
+            y1 = std::clamp(y1, y0, src.height);
+            RectStats stats = table.Stats(x0, y0, x1, y1);
+            std::cout << "[" << x0 << ", " << y0 << ", " << x1 << ", " << y1 << "): mean BGR "
+                << stats.mean[0] << " " << stats.mean[1] << " " << stats.mean[2] << ", variance BGR "
+                << stats.variance[0] << " " << stats.variance[1] << " " << stats.variance[2] << '\n';
+        }
+        std::cout.flush();
+    };
+    if (SatFits32(src.width, src.height)) {
+        run(SummedAreaTable<uint32_t>());
+    } else {
+        run(SummedAreaTable<uint64_t>());
+    }
+}
+
+// Правки из файла (строки "x0 y0 x1 y1 b g r" - залить прямоугольник цветом) с повторным
+// размытием после каждой: пересчитываются только плитки рядом с правкой
+void runEdits(ThreadPool& pool, const std::string& inputPath, const std::string& outputPath, const Options& options) {
+    const FilterPlan& filter = options.filter;
+    if (!filter.boxPasses.empty() || filter.fft || filter.type == FilterType::Sat || !options.pipeline.empty()) {
+        throw std::runtime_error("--edits needs a single-pass tiled filter (box, gauss up to radius 7, median or direct conv).");
+    }
+    std::ifstream list(options.edits);
+    if (!list) {
+        throw std::runtime_error("Could not open edits file: " + options.edits);
+    }
+
+    MappedBMP srcImage = MappedBMP::Open(inputPath);
+    IncrementalBlur engine(srcImage.Pixels(), options.tileW, options.tileH, filter.Halo(),
+        [&](const ImageView& src, const ImageView& dst, const Tile& tile) {
+            if (filter.type == FilterType::Conv) {
+                ConvolveDirectRect(src.data, dst.data, src.width, src.height, src.stride, tile.x0, tile.y0, tile.x1, tile.y1, filter.conv);
+            } else {
+                blurImage(src, dst, tile, filter);
+            }
+        });
+
+    auto timed = [&](const char* what) {
+        auto start = std::chrono::steady_clock::now();
+        size_t tiles = engine.Update(pool);
+        auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << what << ": " << tiles << " tiles, " << time.count() / 1000.0 << " ms" << std::endl;
+    };
+    timed("Initial blur");
+
+    int x0, y0, x1, y1, b, g, r;
+    while (list >> x0 >> y0 >> x1 >> y1 >> b >> g >> r) {
+        ImageView source = engine.Source();
+        for (int y = std::max(y0, 0); y < std::min(y1, source.height); ++y) {
+            for (int x = std::max(x0, 0); x < std::min(x1, source.width); ++x) {
+                uint8_t* p = source.Row(y) + x * 3;
+                p[0] = uint8_t(b);
+                p[1] = uint8_t(g);
+                p[2] = uint8_t(r);
+            }
+        }
+        engine.MarkDirty(x0, y0, x1, y1);
+        timed("Edit");
+    }
+
+    MappedBMP dstImage = MappedBMP::CreateLike(outputPath, srcImage);
+    ImageView result = engine.Result(), out = dstImage.Pixels();
+    for (int y = 0; y < out.height; ++y) {
+        std::memcpy(out.Row(y), result.Row(y), size_t(out.width) * 3);
+    }
+}
+
+// Размытие с изменением размера без промежуточного файла: результат идёт полосами, для
+// каждой размываются только нужные ей строки источника (чтение с ореолом), и полоса сразу
+// же пересчитывается в новый размер. Полоса - около kResizeSourceRows строк источника.
+constexpr int kResizeSourceRows = 256;
+
+unsigned blurRows(ThreadPool& pool, const ImageView& src, const ImageView& dst, int y0, int y1, const Options& options);
+
+unsigned blurResized(ThreadPool& pool, const ImageView& src, const ImageView& dst, const Options& options) {
+    const Resampler resampler(src.width, src.height, dst.width, dst.height, options.resample);
+    const int halo = rowHalo(options);
+    const int bandRows = std::max(int(std::lround(kResizeSourceRows * double(dst.height) / src.height)), 16);
+    std::vector<uint8_t> band;
+    unsigned stolen = 0;
+    for (int oy0 = 0; oy0 < dst.height; oy0 += bandRows) {
+        const int oy1 = std::min(oy0 + bandRows, dst.height);
+        int y0, y1;
+        resampler.SourceRows(oy0, oy1, y0, y1);
+        const int r0 = std::max(y0 - halo, 0), r1 = std::min(y1 + halo, src.height);
+        ImageView window{ src.Row(r0), src.width, r1 - r0, src.stride };
+        if (options.planar) {
+            // Размытые плоскости сразу идут в изменение размера, собирается только результат
+            const Options& bandOptions = options.filter.type == FilterType::Median ? medianStrips(options, y0 - r0, y1 - r0) : options;
+            PixelBuffer blurred;
+            int blurredY0 = 0;
+            stolen += blurPlanes(pool, window, y0 - r0, y1 - r0, bandOptions, blurred, blurredY0);
+            PixelBuffer resized(dst.width, oy1 - oy0, PixelLayout::Planar);
+            resampler.Run(pool, blurred, r0 + blurredY0, resized, oy0, oy0, oy1);
+            const unsigned chunks = pool.Size();
+            pool.Parallel(chunks, [&](unsigned i) {
+                int from = (oy1 - oy0) * int(i) / int(chunks), to = (oy1 - oy0) * int(i + 1) / int(chunks);
+                PackRows(resized, from, to, dst, oy0 + from);
+            });
+            continue;
+        }
+        ImageView blurred = AllocateLike(window, band);
+        stolen += blurRows(pool, window, blurred, y0 - r0, y1 - r0, options);
+        resampler.Run(pool, blurred, r0, dst, oy0, oy1);
+    }
+    return stolen;
+}
+
+// Полос в работе одновременно в режиме --pipelined (чтение, размытие, запись)
+constexpr int kPipelineDepth = 4;
+
+// Уровень пирамиды для превью по умолчанию - не больше 1 Мпикс
+constexpr uint64_t kPreviewPixels = 1 << 20;
+
+// Превью: размытие уровня пирамиды (радиус и сигма уменьшены в 2^level раз) с билинейным
+// увеличением до полного размера. В прогрессивном режиме то же по всем уровням от грубого
+// к исходному; выходной файл перезаписывается после каждого, последний - обычное размытие.
+void runPreview(ThreadPool& pool, const std::string& inputPath, const std::string& outputPath, const Options& options) {
+    if (options.filterType == FilterType::Conv || !options.pipeline.empty()) {
+        throw std::runtime_error("--preview and --progressive support the box, gauss, sat and median filters.");
     }
+    auto start = std::chrono::steady_clock::now();
+    MappedBMP srcImage = MappedBMP::Open(inputPath);
+    MappedBMP dstImage = MappedBMP::CreateLike(outputPath, srcImage);
+    ImageView src = srcImage.Pixels(), dst = dstImage.Pixels();
 
-    BMPHeader bmpHeader;
-    DIBHeader dibHeader;
-    inputFile.read(reinterpret_cast<char*>(&bmpHeader), sizeof(bmpHeader));
-    inputFile.read(reinterpret_cast<char*>(&dibHeader), sizeof(dibHeader));
+    const int top = options.previewLevel >= 0 ? options.previewLevel : PyramidLevelFor(src.width, src.height, kPreviewPixels);
+    ImagePyramid pyramid;
+    pyramid.Build(pool, src, top + 1);
 
-    if (bmpHeader.fileType != 0x4D42) 
-    {
-        std::cerr << "Not a valid BMP file." << std::endl;
+    auto elapsed = [&] {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000.0;
+    };
+    for (int level = pyramid.Levels() - 1; level >= 0; --level) {
+        ImageView view = pyramid.Level(level);
+        std::cout << "Level " << level << " (" << view.width << "x" << view.height << "): ";
+        if (level == 0) {
+            blurRows(pool, src, dst, 0, src.height, options);
+        } else {
+            // Радиус на уровне L в 2^L раз меньше; половина округляется вниз, чтобы не
+            // размыть вдвое сильнее. Радиус 0 - уменьшение уже усреднило сильнее фильтра,
+            // размывать уровень незачем
+            const int radius = int(std::ceil(options.radius / double(1 << level) - 0.5));
+            if (radius == 0) {
+                std::cout << "no blur needed, ";
+                UpsampleBilinear(pool, view, dst);
+            } else {
+                Options scaled = options;
+                scaled.radius = radius;
+                scaled.sigma = options.sigma / double(1 << level);
+                scaled.filter = makeFilterPlan(scaled);
+                PixelBuffer blurred(view.width, view.height);
+                blurRows(pool, view, blurred.View(), 0, view.height, scaled);
+                std::cout << "blurred at " << elapsed() << " ms, ";
+                UpsampleBilinear(pool, blurred.View(), dst);
+            }
+        }
+        std::cout << "written at " << elapsed() << " ms" << std::endl;
+        if (!options.progressive) {
+            break;
+        }
+    }
+}
+
+// Размытие строк [y0, y1) окна src плитками на потоках пула; возвращает число украденных плиток
+unsigned blurRows(ThreadPool& pool, const ImageView& src, const ImageView& dst, int y0, int y1, const Options& options) {
+    if (!options.pipeline.empty()) {
+        return runPipelineRows(pool, src, dst, y0, y1, options);
+    }
+    if (options.filter.type == FilterType::Sat && !options.planar) {
+        return blurRowsSat(pool, src, dst, y0, y1, options);
+    }
+    if (options.filter.type == FilterType::Conv) {
+        const FilterPlan& filter = options.filter;
+        if (!filter.fft) {
+            return runTiles(pool, dst, y0, y1, options, [&](const Tile& tile) {
+                ConvolveDirectRect(src.data, dst.data, src.width, src.height, src.stride, tile.x0, tile.y0, tile.x1, tile.y1, filter.conv);
+            });
+        }
+        // Плитки - верные части блоков БПФ, спектр ядра общий для всех потоков
+        Options blocks = options;
+        blocks.tileW = filter.fft->ValidWidth();
+        blocks.tileH = filter.fft->ValidHeight();
+        blocks.partition = TilePartition::Grid;
+        return runTiles(pool, dst, y0, y1, blocks, [&](const Tile& tile) {
+            filter.fft->ConvolveBlock(src, dst, tile.x0, tile.y0, tile.x1, tile.y1);
+        });
+    }
+    if (options.filter.type == FilterType::Median) {
+        Options strips = medianStrips(options, y0, y1);
+        if (strips.planar) {
+            return blurRowsPlanar(pool, src, dst, y0, y1, strips);
+        }
+        return runTiles(pool, dst, y0, y1, strips, [&](const Tile& tile) {
+            blurImage(src, dst, tile, strips.filter);
+        });
+    }
+    if (options.planar) {
+        return blurRowsPlanar(pool, src, dst, y0, y1, options);
+    }
+    const FilterPlan& filter = options.filter;
+    if (filter.boxPasses.empty()) {
+        return runTiles(pool, dst, y0, y1, options, [&](const Tile& tile) {
+            blurImage(src, dst, tile, filter);
+        });
+    }
+
+    // Расширенный box: проходы идут по копии строк [y0, y1) с полями в ореол со всех сторон,
+    // продолженными крайними пикселями, и чередуют два буфера. Каждый проход считает строки
+    // с запасом на радиусы оставшихся проходов.
+    const int pad = filter.Halo();
+    const int rows = y1 - y0 + 2 * pad;
+    const int paddedW = src.width + 2 * pad;
+    std::vector<uint8_t> storage[2];
+    ImageView padded[2];
+    for (int k = 0; k < 2; ++k) {
+        storage[k].resize(size_t(paddedW) * 3 * rows);
+        padded[k] = ImageView{ storage[k].data(), paddedW, rows, ptrdiff_t(paddedW) * 3 };
+    }
+    const unsigned chunks = pool.Size();
+    pool.Parallel(chunks, [&](unsigned i) {
+        for (int r = rows * int(i) / int(chunks); r < rows * int(i + 1) / int(chunks); ++r) {
+            PadRowReplicate<3>(src.Row(std::clamp(y0 - pad + r, 0, src.height - 1)), src.width, pad, padded[0].Row(r));
+        }
+    });
+
+    int remaining = pad;
+    int in = 0;
+    unsigned stolen = 0;
+    for (int radius : filter.boxPasses) {
+        remaining -= radius;
+        const ImageView& s = padded[in];
+        const ImageView& d = padded[1 - in];
+        stolen += runTiles(pool, d, pad - remaining, rows - pad + remaining, options, [&](const Tile& tile) {
+            BoxBlurRect(s.data, d.data, s.width, s.height, s.stride, tile.x0, tile.y0, tile.x1, tile.y1, radius);
+        });
+        in = 1 - in;
+    }
+    pool.Parallel(chunks, [&](unsigned i) {
+        for (int y = y0 + (y1 - y0) * int(i) / int(chunks); y < y0 + (y1 - y0) * int(i + 1) / int(chunks); ++y) {
+            std::memcpy(dst.Row(y), padded[in].Row(y - y0 + pad) + pad * 3, size_t(src.width) * 3);
+        }
+    });
+    return stolen;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--kernel=", 0) == 0) {
+            if (!ParseBlurKernel(arg.substr(9), options.kernel)) {
+                std::cerr << "Unknown kernel: " << arg.substr(9) << std::endl;
+                return false;
+            }
+            if (!IsBlurKernelSupported(options.kernel)) {
+                std::cerr << "Kernel " << BlurKernelName(options.kernel) << " is not supported by this CPU." << std::endl;
+                return false;
+            }
+        } else if (arg.rfind("--tile=", 0) == 0) {
+            std::string size = arg.substr(7);
+            size_t x = size.find('x');
+            options.tileW = std::stoi(size.substr(0, x));
+            options.tileH = x == std::string::npos ? options.tileW : std::stoi(size.substr(x + 1));
+            if (options.tileW <= 0 || options.tileH <= 0) {
+                std::cerr << "Invalid tile size: " << size << std::endl;
+                return false;
+            }
+        } else if (arg.rfind("--order=", 0) == 0) {
+            if (!ParseTileOrder(arg.substr(8), options.order)) {
+                std::cerr << "Unknown tile order: " << arg.substr(8) << std::endl;
+                return false;
+            }
+        } else if (arg.rfind("--partition=", 0) == 0) {
+            if (!ParseTilePartition(arg.substr(12), options.partition)) {
+                std::cerr << "Unknown partition: " << arg.substr(12) << std::endl;
+                return false;
+            }
+        } else if (arg == "--pipelined") {
+            options.stream = true;
+            options.pipelined = true;
+        } else if (arg.rfind("--io=", 0) == 0) {
+            if (!ParseAsyncIOBackend(arg.substr(5), options.io)) {
+                std::cerr << "Unknown I/O backend: " << arg.substr(5) << std::endl;
+                return false;
+            }
+        } else if (arg == "--stream") {
+            options.stream = true;
+        } else if (arg.rfind("--mem-budget=", 0) == 0) {
+            options.stream = true;
+            options.memoryBudget = std::stoull(arg.substr(13)) << 20;
+        } else if (arg == "--batch") {
+            options.batch = true;
+        } else if (arg.rfind("--batch-depth=", 0) == 0) {
+            options.batchDepth = std::max(std::stoi(arg.substr(14)), 1);
+        } else if (arg.rfind("--filter=", 0) == 0) {
+            std::string name = arg.substr(9);
+            if (name == "box") {
+                options.filterType = FilterType::Box;
+            } else if (name == "gauss") {
+                options.filterType = FilterType::Gauss;
+            } else if (name == "sat") {
+                options.filterType = FilterType::Sat;
+            } else if (name == "median") {
+                options.filterType = FilterType::Median;
+            } else {
+                std::cerr << "Unknown filter: " << name << std::endl;
+                return false;
+            }
+        } else if (arg.rfind("--radius=", 0) == 0) {
+            options.radius = std::stoi(arg.substr(9));
+            if (options.radius <= 0) {
+                std::cerr << "Invalid radius: " << arg.substr(9) << std::endl;
+                return false;
+            }
+        } else if (arg.rfind("--pipeline=", 0) == 0) {
+            if (!ParseStencilPipeline(arg.substr(11), options.pipeline)) {
+                std::cerr << "Invalid pipeline: " << arg.substr(11) << std::endl;
+                return false;
+            }
+        } else if (arg == "--unfused") {
+            options.unfused = true;
+        } else if (arg.rfind("--iterations=", 0) == 0) {
+            options.iterations = std::max(std::stoi(arg.substr(13)), 1);
+        } else if (arg.rfind("--time-block=", 0) == 0) {
+            options.timeBlock = std::max(std::stoi(arg.substr(13)), 1);
+        } else if (arg.rfind("--conv=", 0) == 0) {
+            options.convPath = arg.substr(7);
+            options.filterType = FilterType::Conv;
+        } else if (arg.rfind("--conv-mode=", 0) == 0) {
+            options.convMode = arg.substr(12);
+            if (options.convMode != "auto" && options.convMode != "direct" && options.convMode != "fft") {
+                std::cerr << "Unknown convolution mode: " << options.convMode << std::endl;
+                return false;
+            }
+        } else if (arg == "--preview") {
+            options.preview = true;
+        } else if (arg == "--progressive") {
+            options.progressive = true;
+        } else if (arg.rfind("--preview-level=", 0) == 0) {
+            options.previewLevel = std::stoi(arg.substr(16));
+            if (options.previewLevel < 0) {
+                std::cerr << "Invalid preview level: " << arg << std::endl;
+                return false;
+            }
+        } else if (arg.rfind("--resize=", 0) == 0) {
+            std::string size = arg.substr(9);
+            size_t x = size.find('x');
+            if (x == std::string::npos) {
+                std::cerr << "Invalid resize, expected WxH: " << size << std::endl;
+                return false;
+            }
+            options.resizeW = std::stoi(size.substr(0, x));
+            options.resizeH = std::stoi(size.substr(x + 1));
+            if (options.resizeW <= 0 || options.resizeH <= 0) {
+                std::cerr << "Invalid resize: " << size << std::endl;
+                return false;
+            }
+        } else if (arg.rfind("--resample=", 0) == 0) {
+            if (!ParseResampleFilter(arg.substr(11), options.resample)) {
+                std::cerr << "Unknown resample filter: " << arg.substr(11) << std::endl;
+                return false;
+            }
+        } else if (arg.rfind("--edits=", 0) == 0) {
+            options.edits = arg.substr(8);
+        } else if (arg.rfind("--roi=", 0) == 0) {
+            options.roi = arg.substr(6);
+        } else if (arg.rfind("--regions=", 0) == 0) {
+            options.regions = arg.substr(10);
+        } else if (arg.rfind("--squares=", 0) == 0) {
+            options.squares = unsigned(std::max(std::stoi(arg.substr(10)), 0));
+        } else if (arg.rfind("--square-size=", 0) == 0) {
+            options.squareSize = unsigned(std::max(std::stoi(arg.substr(14)), 1));
+        } else if (arg.rfind("--seed=", 0) == 0) {
+            options.seed = uint32_t(std::stoul(arg.substr(7)));
+        } else if (arg == "--planar") {
+            options.planar = true;
+        } else if (arg.rfind("--sigma=", 0) == 0) {
+            options.sigma = std::stod(arg.substr(8));
+        } else {
+            options.positional.push_back(arg);
+        }
+    }
+    // Полосы во всю ширину идут только сверху вниз, обходить их по кривой нечего
+    if (options.partition == TilePartition::Rows && options.order != TileOrder::Row) {
+        std::cerr << "--partition=rows supports only --order=row" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) 
+{
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
         return 1;
     }
 
-    int width = dibHeader.width;
-    int height = dibHeader.height;
-    int imageSize = width * height * 3;
-    std::vector<uint8_t> srcImage(imageSize);
-    std::vector<uint8_t> dstImage(imageSize);
-    inputFile.seekg(bmpHeader.offsetData, std::ios::beg);
-    inputFile.read(reinterpret_cast<char*>(srcImage.data()), imageSize);
-    inputFile.close();
+    const std::vector<std::string>& args = options.positional;
+    if (args.size() < 3) {
+        std::cerr << "Usage: " << argv[0] << " <input.bmp> <output.bmp> <num_threads>"
+            << " [--kernel=scalar|sse|avx2|avx512] [--tile=N|WxH] [--order=row|column|serpentine|morton|hilbert]"
+            << " [--partition=grid|tiles|rows|auto]"
+            << " [--stream] [--pipelined [--io=auto|uring|threads]] [--mem-budget=MB] [--filter=box|gauss|sat|median] [--radius=N] [--sigma=S] [--planar]"
+            << " [--pipeline=blur:R,sharpen,sobel,threshold:T [--unfused]]"
+            << " [--iterations=N] [--time-block=K]"
+            << " [--regions=rects.txt] [--roi=rects.txt] [--edits=edits.txt] [--preview|--progressive [--preview-level=N]]"
+            << " [--resize=WxH [--resample=box|bilinear|lanczos3]] [--conv=kernel.txt [--conv-mode=auto|direct|fft]]"
+            << " [--squares=N [--square-size=K] [--seed=S]]" << std::endl
+            << "       " << argv[0] << " --batch <input_dir|list.txt> <output_dir> <num_threads> [--batch-depth=N]" << std::endl;
+        return 1;
+    }
 
-    int blockSize = 16; 
-    int numBlocks = (width * height) / (blockSize * blockSize);
-    int blocksPerThread = numBlocks / numThreads;
+    const char* inputFilename = args[0].c_str();
+    const char* outputFilename = args[1].c_str();
+    int numThreads = std::stoi(args[2]);
+    blurKernel = GetBlurKernel(options.kernel);
+    options.filter = makeFilterPlan(options);
 
-    std::vector<std::jthread> threads;
-    for (int i = 0; i < numThreads; ++i) {
-        threads.emplace_back(processBlocks, srcImage.data(), dstImage.data(), width, height, blockSize, blocksPerThread, i);
+    if (options.resizeW > 0 && (options.batch || options.stream || !options.roi.empty() || !options.edits.empty()
+        || options.preview || options.progressive)) {
+        std::cerr << "--resize works with the memory-mapped mode only." << std::endl;
+        return 1;
     }
 
-    std::ofstream outputFile(outputFilename, std::ios::binary);
-    if (!outputFile) {
-        std::cerr << "Error opening output file." << std::endl;
+    // N проходов - это конвейер из N копий этапов (по умолчанию box-размытия радиуса --radius)
+    if (options.iterations > 1) {
+        if (options.pipeline.empty() && options.filterType != FilterType::Box) {
+            std::cerr << "--iterations supports the box filter and --pipeline only." << std::endl;
+            return 1;
+        }
+        std::vector<StencilStage> base = options.pipeline;
+        if (base.empty()) {
+            base.push_back(StencilStage{ StencilKind::Blur, options.radius });
+        }
+        options.pipeline.clear();
+        for (int i = 0; i < options.iterations; ++i) {
+            options.pipeline.insert(options.pipeline.end(), base.begin(), base.end());
+        }
+    }
+    // Проверяется после --iterations: несколько проходов - тоже конвейер этапов
+    if (options.planar && !supportsPlanar(options)) {
+        std::cerr << "--planar supports the box, gauss, sat and median filters (not --conv, --pipeline or --iterations)." << std::endl;
+        return 1;
+    }
+
+    try {
+        ThreadPool pool(numThreads);
+        if (options.batch) {
+            BatchStats stats = RunBatch(ListBatchInputs(inputFilename), outputFilename, options.batchDepth,
+                [&](const ImageView& src, const ImageView& dst) {
+                    blurRows(pool, src, dst, 0, src.height, options);
+                });
+            std::cout << "Images: " << stats.images << " (failed: " << stats.failed << "), total: " << stats.seconds * 1000 << " ms, "
+                << (stats.seconds > 0 ? stats.images / stats.seconds : 0) << " images/sec" << std::endl;
+            return stats.failed == 0 ? 0 : 1;
+        }
+
+        auto blurStart = std::chrono::steady_clock::now();
+        unsigned stolen = 0;
+        if (options.squares > 0) {
+            // Квадраты задаются только seed: результат одинаков при любом числе потоков
+            BMPImage image(inputFilename);
+            if (options.planar) {
+                image.SetLayout(PixelLayout::Planar);
+            }
+            image.BlurDeterministic(unsigned(numThreads), options.seed, options.squares, options.squareSize);
+            image.Save(outputFilename);
+        } else if (options.preview || options.progressive) {
+            runPreview(pool, inputFilename, outputFilename, options);
+        } else if (!options.edits.empty()) {
+            runEdits(pool, inputFilename, outputFilename, options);
+        } else if (!options.roi.empty()) {
+            RoiStats stats = BlurRegions(inputFilename, outputFilename, LoadRoiRects(options.roi), rowHalo(options),
+                [&](const ImageView& src, const ImageView& dst, int y0, int y1) {
+                    stolen += blurRows(pool, src, dst, y0, y1, options);
+                });
+            std::cout << "Regions: " << stats.rects << ", read " << (stats.bytesRead >> 10) << " KB, written "
+                << (stats.bytesWritten >> 10) << " KB of " << (stats.imageBytes >> 10) << " KB image" << std::endl;
+        } else if (options.stream) {
+            auto blurBand = [&](const ImageView& src, const ImageView& dst, int y0, int y1) {
+                stolen += blurRows(pool, src, dst, y0, y1, options);
+            };
+            StreamStats stats = options.pipelined
+                ? StreamBlurBMPPipelined(inputFilename, outputFilename, options.memoryBudget, rowHalo(options),
+                    options.io, kPipelineDepth, blurBand)
+                : StreamBlurBMP(inputFilename, outputFilename, options.memoryBudget, rowHalo(options), blurBand);
+            std::cout << "Streamed " << stats.bands << " bands of " << stats.bandRows << " rows, buffers: "
+                << (stats.bufferBytes >> 10) << " KB" << std::endl;
+            if (options.pipelined) {
+                std::cout << "I/O: " << stats.backend << ", waited " << stats.ioWaitSeconds * 1000 << " ms, blur "
+                    << stats.blurSeconds * 1000 << " ms" << std::endl;
+            }
+        } else {
+            MappedBMP srcImage = MappedBMP::Open(inputFilename);
+            ImageView src = srcImage.Pixels();
+            if (!options.regions.empty()) {
+                printRegionStats(pool, src, options.regions);
+            }
+            if (options.resizeW > 0) {
+                MappedBMP dstImage = MappedBMP::Create(outputFilename, options.resizeW, options.resizeH, srcImage.Layout().topDown);
+                stolen = blurResized(pool, src, dstImage.Pixels(), options);
+            } else {
+                MappedBMP dstImage = MappedBMP::CreateLike(outputFilename, srcImage);
+                stolen = blurRows(pool, src, dstImage.Pixels(), 0, src.height, options);
+            }
+        }
+        auto blurTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - blurStart);
+        std::cout << "Kernel: " << BlurKernelName(options.kernel) << ", blur time: " << blurTime.count() / 1000.0 << " ms"
+            << ", tiles stolen: " << stolen << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
         return 1;
     }
-    outputFile.write(reinterpret_cast<char*>(&bmpHeader), sizeof(bmpHeader));
-    outputFile.write(reinterpret_cast<char*>(&dibHeader), sizeof(dibHeader));
-    outputFile.seekp(bmpHeader.offsetData, std::ios::beg);
-    outputFile.write(reinterpret_cast<char*>(dstImage.data()), imageSize);
-    outputFile.close();
 
     std::cout << "Blurring complete!" << std::endl;
     return 0;
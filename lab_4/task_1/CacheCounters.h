@@ -0,0 +1,115 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <utility>
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Аппаратные счётчики промахов кэша за участок программы (Linux, perf_event_open).
+// Счётчики открываются на текущий процесс с inherit, поэтому учитывают и потоки,
+// созданные после Start; читать их нужно после join этих потоков. Без поддержки
+// (Windows, виртуальная машина без PMU, perf_event_paranoid) значения недоступны.
+// Отдельного общего события для L2 у perf нет: уровень L1D и последний уровень (LLC)
+// плюс общие cache-misses процессора.
+class CacheCounters {
+public:
+    enum Counter {
+        L1DMisses,
+        LLCMisses,
+        CacheMisses,
+        Count
+    };
+
+    static const char* Name(Counter counter) {
+        switch (counter) {
+        case L1DMisses: return "L1D misses";
+        case LLCMisses: return "LLC misses";
+        default: return "cache misses";
+        }
+    }
+
+    CacheCounters() {
+#ifdef __linux__
+        auto cache = [](uint64_t id, uint64_t result) {
+            return id | (uint64_t(PERF_COUNT_HW_CACHE_OP_READ) << 8) | (result << 16);
+        };
+        const std::pair<uint32_t, uint64_t> events[Count] = {
+            { PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+            { PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        };
+        for (int i = 0; i < Count; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events[i].first;
+            attr.config = events[i].second;
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fds[i] = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#endif
+    }
+
+    ~CacheCounters() {
+#ifdef __linux__
+        for (int fd : fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+#endif
+    }
+
+    CacheCounters(const CacheCounters&) = delete;
+    CacheCounters& operator=(const CacheCounters&) = delete;
+
+    bool Available(Counter counter) const { return fds[counter] >= 0; }
+
+    void Start() {
+#ifdef __linux__
+        for (int fd : fds) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    void Stop() {
+#ifdef __linux__
+        for (int fd : fds) {
+            if (fd >= 0) {
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+#endif
+    }
+
+    // Значение счётчика после Stop (с inherit - сумма по всем завершённым потокам)
+    bool Read(Counter counter, uint64_t& value) const {
+#ifdef __linux__
+        return fds[counter] >= 0 && read(fds[counter], &value, sizeof(value)) == ssize_t(sizeof(value));
+#else
+        (void)counter;
+        (void)value;
+        return false;
+#endif
+    }
+
+    std::string Format(Counter counter) const {
+        uint64_t value = 0;
+        return Read(counter, value) ? std::to_string(value) : std::string("n/a");
+    }
+
+private:
+    int fds[Count] = { -1, -1, -1 };
+};
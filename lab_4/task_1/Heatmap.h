@@ -0,0 +1,109 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "MappedBMP.h"
+#include "Trace.h"
+
+struct BGR {
+    uint8_t b, g, r;
+};
+
+// Различимые цвета потоков: оттенок по золотому углу
+inline BGR ThreadColor(unsigned thread) {
+    double h = std::fmod(thread * 137.508, 360.0) / 60.0;
+    double x = 1 - std::fabs(std::fmod(h, 2.0) - 1);
+    double r = 0, g = 0, b = 0;
+    switch (int(h)) {
+    case 0: r = 1; g = x; break;
+    case 1: r = x; g = 1; break;
+    case 2: g = 1; b = x; break;
+    case 3: g = x; b = 1; break;
+    case 4: r = x; b = 1; break;
+    default: r = 1; b = x; break;
+    }
+    auto channel = [](double v) { return static_cast<uint8_t>(40 + v * 215); };
+    return BGR{ channel(b), channel(g), channel(r) };
+}
+
+// Шкала синий -> зелёный -> красный для t из [0, 1]
+inline BGR HeatColor(double t) {
+    t = std::clamp(t, 0.0, 1.0);
+    auto channel = [](double v) { return static_cast<uint8_t>(std::lround(std::clamp(v, 0.0, 1.0) * 255)); };
+    return BGR{ channel(1 - 2 * t), channel(1 - std::fabs(2 * t - 1)), channel(2 * t - 1) };
+}
+
+// Изображение размера исходного, каждая плитка залита цветом color(event)
+template <typename ColorFn>
+inline void WriteTileMap(const std::string& path, int width, int height, const std::vector<TraceEvent>& events, ColorFn color) {
+    MappedBMP bmp = MappedBMP::Create(path, width, height);
+    ImageView view = bmp.Pixels();
+    for (const TraceEvent& e : events) {
+        BGR c = color(e);
+        for (int y = e.y0; y < e.y1; ++y) {
+            uint8_t* row = view.Row(y);
+            for (int x = e.x0; x < e.x1; ++x) {
+                row[x * 3] = c.b;
+                row[x * 3 + 1] = c.g;
+                row[x * 3 + 2] = c.r;
+            }
+        }
+    }
+}
+
+// Две карты рядом с результатом: <имя>_threads.bmp (какой поток) и <имя>_time.bmp (сколько нс)
+inline void WriteHeatmaps(const std::string& outputPath, int width, int height, const std::vector<TraceEvent>& events, double nsPerTick) {
+    std::filesystem::path base(outputPath);
+    std::string stem = (base.parent_path() / base.stem()).string();
+
+    WriteTileMap(stem + "_threads.bmp", width, height, events, [](const TraceEvent& e) { return ThreadColor(e.thread); });
+
+    uint64_t minTicks = UINT64_MAX, maxTicks = 0;
+    for (const TraceEvent& e : events) {
+        minTicks = std::min(minTicks, e.end - e.begin);
+        maxTicks = std::max(maxTicks, e.end - e.begin);
+    }
+    // Логарифмическая шкала: единичные выбросы (промах страницы) не съедают весь диапазон
+    double low = std::log(double(std::max<uint64_t>(minTicks, 1)));
+    double range = std::max(std::log(double(std::max<uint64_t>(maxTicks, 1))) - low, 1e-9);
+    WriteTileMap(stem + "_time.bmp", width, height, events, [&](const TraceEvent& e) {
+        return HeatColor((std::log(double(std::max<uint64_t>(e.end - e.begin, 1))) - low) / range);
+    });
+    if (!events.empty()) {
+        std::cout << "Tile time: " << std::llround(minTicks * nsPerTick) << " ns (blue) .. "
+            << std::llround(maxTicks * nsPerTick) << " ns (red)" << std::endl;
+    }
+}
+
+// Сводка по потокам: простой = от первого начала до последнего окончания минус занятость
+inline void WriteThreadSummary(std::ostream& out, unsigned numThreads, const std::vector<TraceEvent>& events, double nsPerTick) {
+    struct Row {
+        uint64_t tiles = 0, pixels = 0, busy = 0;
+    };
+    std::vector<Row> rows(numThreads);
+    uint64_t first = UINT64_MAX, last = 0;
+    for (const TraceEvent& e : events) {
+        Row& row = rows[e.thread];
+        ++row.tiles;
+        row.pixels += uint64_t(e.x1 - e.x0) * uint64_t(e.y1 - e.y0);
+        row.busy += e.end - e.begin;
+        first = std::min(first, e.begin);
+        last = std::max(last, e.end);
+    }
+    uint64_t wall = last > first ? last - first : 0;
+
+    out << std::setw(6) << "Thread" << std::setw(8) << "Tiles" << std::setw(12) << "Pixels"
+        << std::setw(14) << "Busy, us" << std::setw(14) << "Idle, us" << std::endl;
+    for (unsigned t = 0; t < numThreads; ++t) {
+        const Row& row = rows[t];
+        out << std::setw(6) << t << std::setw(8) << row.tiles << std::setw(12) << row.pixels
+            << std::setw(14) << std::fixed << std::setprecision(1) << row.busy * nsPerTick / 1000
+            << std::setw(14) << (wall - std::min(wall, row.busy)) * nsPerTick / 1000 << std::endl;
+    }
+}
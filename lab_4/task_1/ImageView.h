@@ -0,0 +1,14 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// Окно на BGR24 пиксели: строка y начинается с data + y * stride.
+// stride может быть отрицательным (BMP со строками снизу вверх).
+struct ImageView {
+    uint8_t* data = nullptr;
+    int width = 0;
+    int height = 0;
+    ptrdiff_t stride = 0;
+
+    uint8_t* Row(int y) const { return data + y * stride; }
+};
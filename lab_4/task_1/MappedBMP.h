@@ -0,0 +1,299 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include "ImageView.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Структуры для хранения BMP заголовков
+#pragma pack(push, 1)
+struct BMPHeader {
+    uint16_t fileType;      // Тип файла (BM)
+    uint32_t fileSize;      // Размер файла в байтах
+    uint16_t reserved1;     // Зарезервировано
+    uint16_t reserved2;     // Зарезервировано
+    uint32_t offsetData;    // Смещение до начала данных изображения
+};
+
+struct DIBHeader {
+    uint32_t size;          // Размер DIB заголовка
+    int32_t width;          // Ширина изображения
+    int32_t height;         // Высота изображения
+    uint16_t planes;        // Количество цветовых плоскостей
+    uint16_t bitCount;      // Количество бит на пиксель
+    uint32_t compression;    // Метод сжатия
+    uint32_t sizeImage;     // Размер изображения
+    int32_t xPelsPerMeter;   // Горизонтальное разрешение
+    int32_t yPelsPerMeter;   // Вертикальное разрешение
+    uint32_t colorsUsed;     // Количество используемых цветов
+    uint32_t colorsImportant; // Количество важных цветов
+};
+#pragma pack(pop)
+
+// Расположение пикселей 24-битного BMP в файле
+struct BMPLayout {
+    int width = 0;
+    int height = 0;
+    bool topDown = false;       // отрицательная высота в заголовке
+    uint64_t rowBytes = 0;      // строка с выравниванием до 4 байт
+    uint64_t dataOffset = 0;
+
+    uint64_t DataSize() const { return rowBytes * uint64_t(height); }
+
+    // Смещение в файле логической строки y (сверху вниз)
+    uint64_t RowOffset(int y) const {
+        return dataOffset + rowBytes * uint64_t(topDown ? y : height - 1 - y);
+    }
+};
+
+inline BMPLayout ParseBMPLayout(const BMPHeader& bmpHeader, const DIBHeader& dibHeader, uint64_t fileSize) {
+    if (bmpHeader.fileType != 0x4D42) {
+        throw std::runtime_error("Not a valid BMP file.");
+    }
+    if (dibHeader.bitCount != 24 || dibHeader.compression != 0) {
+        throw std::runtime_error("Only uncompressed 24-bit BMP files are supported.");
+    }
+    if (dibHeader.width <= 0 || dibHeader.height == 0 || dibHeader.height == INT32_MIN) {
+        throw std::runtime_error("Invalid BMP dimensions.");
+    }
+
+    BMPLayout layout;
+    layout.width = dibHeader.width;
+    layout.height = dibHeader.height < 0 ? -dibHeader.height : dibHeader.height;
+    layout.topDown = dibHeader.height < 0;
+    layout.rowBytes = (uint64_t(layout.width) * 3 + 3) & ~uint64_t(3);
+    layout.dataOffset = bmpHeader.offsetData;
+    if (layout.dataOffset < sizeof(BMPHeader) + sizeof(DIBHeader) || layout.dataOffset + layout.DataSize() > fileSize) {
+        throw std::runtime_error("BMP pixel data is out of file bounds.");
+    }
+    return layout;
+}
+
+// Отображение файла в память: только чтение или чтение и запись
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            Close();
+            std::swap(data, other.data);
+            std::swap(size, other.size);
+#ifdef _WIN32
+            std::swap(file, other.file);
+            std::swap(mapping, other.mapping);
+#else
+            std::swap(fd, other.fd);
+#endif
+        }
+        return *this;
+    }
+
+    ~MappedFile() { Close(); }
+
+    static MappedFile OpenRead(const std::string& path) {
+        MappedFile mapped;
+#ifdef _WIN32
+        mapped.file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (mapped.file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Could not open file for reading: " + path);
+        }
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(mapped.file, &fileSize);
+        mapped.size = static_cast<uint64_t>(fileSize.QuadPart);
+        mapped.Map(PAGE_READONLY, FILE_MAP_READ);
+#else
+        mapped.fd = open(path.c_str(), O_RDONLY);
+        if (mapped.fd < 0) {
+            throw std::runtime_error("Could not open file for reading: " + path);
+        }
+        struct stat st;
+        fstat(mapped.fd, &st);
+        mapped.size = static_cast<uint64_t>(st.st_size);
+        mapped.Map(PROT_READ);
+#endif
+        return mapped;
+    }
+
+    // Новый файл заданного размера; страницы пишутся напрямую, без промежуточного буфера
+    static MappedFile Create(const std::string& path, uint64_t size) {
+        MappedFile mapped;
+        mapped.size = size;
+#ifdef _WIN32
+        mapped.file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (mapped.file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Could not open file for writing: " + path);
+        }
+        mapped.Map(PAGE_READWRITE, FILE_MAP_WRITE);
+#else
+        mapped.fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (mapped.fd < 0) {
+            throw std::runtime_error("Could not open file for writing: " + path);
+        }
+        if (ftruncate(mapped.fd, static_cast<off_t>(size)) != 0) {
+            throw std::runtime_error("Could not resize file: " + path);
+        }
+        mapped.Map(PROT_READ | PROT_WRITE);
+#endif
+        return mapped;
+    }
+
+    uint8_t* Data() const { return data; }
+    uint64_t Size() const { return size; }
+
+private:
+    uint8_t* data = nullptr;
+    uint64_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+
+    void Map(DWORD protect, DWORD access) {
+        mapping = CreateFileMappingA(file, nullptr, protect, DWORD(size >> 32), DWORD(size), nullptr);
+        void* view = mapping ? MapViewOfFile(mapping, access, 0, 0, 0) : nullptr;
+        if (!view) {
+            throw std::runtime_error("Could not map file.");
+        }
+        data = static_cast<uint8_t*>(view);
+    }
+
+    void Close() {
+        if (data) {
+            UnmapViewOfFile(data);
+        }
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        data = nullptr;
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+        size = 0;
+    }
+#else
+    int fd = -1;
+
+    void Map(int protect) {
+        if (size == 0) {
+            throw std::runtime_error("Could not map empty file.");
+        }
+        void* view = mmap(nullptr, size, protect, MAP_SHARED, fd, 0);
+        if (view == MAP_FAILED) {
+            throw std::runtime_error("Could not map file.");
+        }
+        data = static_cast<uint8_t*>(view);
+    }
+
+    void Close() {
+        if (data) {
+            munmap(data, size);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        data = nullptr;
+        fd = -1;
+        size = 0;
+    }
+#endif
+};
+
+// 24-битный BMP, отображённый в память. Pixels() смотрит прямо на страницы файла
+// с учётом выравнивания строк и ориентации: строка 0 всегда верхняя.
+class MappedBMP {
+public:
+    static MappedBMP Open(const std::string& path) {
+        MappedBMP bmp;
+        bmp.file = MappedFile::OpenRead(path);
+        if (bmp.file.Size() < sizeof(BMPHeader) + sizeof(DIBHeader)) {
+            throw std::runtime_error("Not a valid BMP file.");
+        }
+        bmp.ReadLayout();
+        return bmp;
+    }
+
+    // Файл с теми же заголовками (и всем, что лежит до пикселей), что у образца
+    static MappedBMP CreateLike(const std::string& path, const MappedBMP& like) {
+        MappedBMP bmp;
+        uint64_t size = like.layout.dataOffset + like.layout.DataSize();
+        bmp.file = MappedFile::Create(path, size);
+        std::memcpy(bmp.file.Data(), like.file.Data(), like.layout.dataOffset);
+        bmp.ReadLayout();
+        reinterpret_cast<BMPHeader*>(bmp.file.Data())->fileSize = size > UINT32_MAX ? 0 : static_cast<uint32_t>(size);
+        return bmp;
+    }
+
+    // Новый 24-битный BMP с минимальными заголовками
+    static MappedBMP Create(const std::string& path, int width, int height, bool topDown = false) {
+        BMPHeader bmpHeader{};
+        DIBHeader dibHeader{};
+        uint64_t rowBytes = (uint64_t(width) * 3 + 3) & ~uint64_t(3);
+        uint64_t dataSize = rowBytes * uint64_t(height);
+        uint64_t size = sizeof(BMPHeader) + sizeof(DIBHeader) + dataSize;
+        bmpHeader.fileType = 0x4D42;
+        bmpHeader.fileSize = size > UINT32_MAX ? 0 : static_cast<uint32_t>(size);
+        bmpHeader.offsetData = sizeof(BMPHeader) + sizeof(DIBHeader);
+        dibHeader.size = sizeof(DIBHeader);
+        dibHeader.width = width;
+        dibHeader.height = topDown ? -height : height;
+        dibHeader.planes = 1;
+        dibHeader.bitCount = 24;
+        dibHeader.sizeImage = dataSize > UINT32_MAX ? 0 : static_cast<uint32_t>(dataSize);
+        dibHeader.xPelsPerMeter = 2835;
+        dibHeader.yPelsPerMeter = 2835;
+
+        MappedBMP bmp;
+        bmp.file = MappedFile::Create(path, size);
+        std::memcpy(bmp.file.Data(), &bmpHeader, sizeof(bmpHeader));
+        std::memcpy(bmp.file.Data() + sizeof(bmpHeader), &dibHeader, sizeof(dibHeader));
+        bmp.ReadLayout();
+        return bmp;
+    }
+
+    const BMPLayout& Layout() const { return layout; }
+    int Width() const { return layout.width; }
+    int Height() const { return layout.height; }
+
+    const BMPHeader& Header() const { return *reinterpret_cast<const BMPHeader*>(file.Data()); }
+    const DIBHeader& Info() const { return *reinterpret_cast<const DIBHeader*>(file.Data() + sizeof(BMPHeader)); }
+
+    ImageView Pixels() const {
+        ImageView view;
+        view.width = layout.width;
+        view.height = layout.height;
+        view.data = file.Data() + layout.RowOffset(0);
+        view.stride = layout.topDown ? ptrdiff_t(layout.rowBytes) : -ptrdiff_t(layout.rowBytes);
+        return view;
+    }
+
+private:
+    MappedFile file;
+    BMPLayout layout;
+
+    void ReadLayout() {
+        BMPHeader bmpHeader;
+        DIBHeader dibHeader;
+        std::memcpy(&bmpHeader, file.Data(), sizeof(bmpHeader));
+        std::memcpy(&dibHeader, file.Data() + sizeof(bmpHeader), sizeof(dibHeader));
+        layout = ParseBMPLayout(bmpHeader, dibHeader, file.Size());
+    }
+};
@@ -0,0 +1,154 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Часы трассировки: счётчик тактов (инвариантный TSC на современных x86), вне x86 - steady_clock.
+// Перевод в наносекунды - по калибровке относительно steady_clock за время записи.
+struct TraceClock {
+    static uint64_t Now() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+};
+
+// Одно событие фиксированного размера: обработка плитки потоком
+struct TraceEvent {
+    uint64_t begin;
+    uint64_t end;
+    uint32_t thread;
+    uint32_t tile;
+    int32_t x0, y0, x1, y1;
+};
+
+// Кольцевой буфер одного потока: пишет только владелец, читают после join, поэтому
+// ни блокировок, ни атомарных операций. При переполнении затираются самые старые события.
+class alignas(64) TraceRing {
+public:
+    explicit TraceRing(size_t capacity) : events(std::max<size_t>(capacity, 1)) {}
+
+    void Record(const TraceEvent& event) {
+        events[head % events.size()] = event;
+        ++head;
+    }
+
+    size_t Size() const { return std::min<size_t>(head, events.size()); }
+    uint64_t Dropped() const { return head > events.size() ? head - events.size() : 0; }
+
+    // События в порядке записи
+    template <typename Fn>
+    void ForEach(Fn fn) const {
+        for (uint64_t i = head - Size(); i < head; ++i) {
+            fn(events[i % events.size()]);
+        }
+    }
+
+private:
+    std::vector<TraceEvent> events;
+    uint64_t head = 0;
+};
+
+// Ёмкость кольца потока: его доля плиток вдвое (с запасом на кражу у соседей), но не меньше
+// kMinTraceEventsPerThread - на малых изображениях один поток успевает забрать почти все
+// плитки - и не больше kMaxTraceEventsPerThread (2.5 МБ на поток при любом изображении).
+// Что не поместилось, затирается и учитывается в Dropped.
+constexpr size_t kMinTraceEventsPerThread = 4096;
+constexpr size_t kMaxTraceEventsPerThread = size_t(1) << 16;
+
+inline size_t TraceEventsPerThread(size_t tiles, unsigned numThreads) {
+    size_t share = (tiles + std::max(numThreads, 1u) - 1) / std::max(numThreads, 1u);
+    size_t capacity = std::clamp(2 * share, kMinTraceEventsPerThread, kMaxTraceEventsPerThread);
+    return std::min(capacity, std::max<size_t>(tiles, 1));
+}
+
+class TraceRecorder {
+public:
+    TraceRecorder(unsigned numThreads, size_t eventsPerThread)
+        : startTicks(TraceClock::Now()), startTime(std::chrono::steady_clock::now())
+    {
+        for (unsigned i = 0; i < std::max(numThreads, 1u); ++i) {
+            rings.push_back(std::make_unique<TraceRing>(eventsPerThread));
+        }
+    }
+
+    TraceRing& Ring(unsigned thread) { return *rings[thread]; }
+
+    uint64_t Dropped() const {
+        uint64_t dropped = 0;
+        for (const auto& ring : rings) {
+            dropped += ring->Dropped();
+        }
+        return dropped;
+    }
+
+    // Все события по времени начала; вызывать после завершения потоков
+    std::vector<TraceEvent> Merge() const {
+        std::vector<TraceEvent> merged;
+        for (const auto& ring : rings) {
+            ring->ForEach([&](const TraceEvent& e) { merged.push_back(e); });
+        }
+        std::sort(merged.begin(), merged.end(), [](const TraceEvent& a, const TraceEvent& b) { return a.begin < b.begin; });
+        return merged;
+    }
+
+    // Наносекунд на такт часов, по калибровке от создания до текущего момента
+    double NsPerTick() const {
+        uint64_t ticks = TraceClock::Now() - startTicks;
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count();
+        return ticks > 0 ? ns / ticks : 1.0;
+    }
+
+    // Формат Chrome Trace Event (chrome://tracing, Perfetto): полные события "X", время в мкс
+    void WriteChromeJson(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out) {
+            throw std::runtime_error("Could not open trace file: " + path);
+        }
+        double scale = NsPerTick() / 1000.0;
+        out << "{\"traceEvents\":[\n";
+        bool first = true;
+        for (const TraceEvent& e : Merge()) {
+            out << (first ? "" : ",\n") << "{\"name\":\"tile " << e.tile << "\",\"cat\":\"blur\",\"ph\":\"X\",\"pid\":0,\"tid\":" << e.thread
+                << ",\"ts\":" << (e.begin - startTicks) * scale << ",\"dur\":" << (e.end - e.begin) * scale
+                << ",\"args\":{\"x0\":" << e.x0 << ",\"y0\":" << e.y0 << ",\"x1\":" << e.x1 << ",\"y1\":" << e.y1 << "}}";
+            first = false;
+        }
+        out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+    }
+
+    // Прежний текстовый журнал: строка на пиксель с временем начала его плитки
+    void WriteText(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out) {
+            throw std::runtime_error("Could not open log file: " + path);
+        }
+        double scale = NsPerTick() / 1e6;
+        for (const TraceEvent& e : Merge()) {
+            auto ms = static_cast<long long>((e.begin - startTicks) * scale);
+            for (int y = e.y0; y < e.y1; ++y) {
+                for (int x = e.x0; x < e.x1; ++x) {
+                    out << ms << " ms, Thread: " << e.thread << ", Pixel: (" << x << ", " << y << ")\n";
+                }
+            }
+        }
+    }
+
+private:
+    uint64_t startTicks;
+    std::chrono::steady_clock::time_point startTime;
+    std::vector<std::unique_ptr<TraceRing>> rings;
+};
@@ -2,154 +2,154 @@
 #include <fstream>
 #include <vector>
 #include <thread>
-#include <mutex>
 #include <chrono>
 #include <cmath>
 #include <cstring>
+#include <string>
+#include "BoxBlur.h"
+#include "TileScheduler.h"
+#include "MappedBMP.h"
+#include "Trace.h"
+#include "Heatmap.h"
+#include "CacheCounters.h"
 #include <windows.h>
 #include <algorithm>
 
-// Структуры для хранения BMP заголовков
-#pragma pack(push, 1)
-struct BMPHeader {
-    uint16_t fileType;
-    uint32_t fileSize;
-    uint16_t reserved1;
-    uint16_t reserved2;
-    uint32_t offsetData;
-};
-
-struct DIBHeader {
-    uint32_t size;
-    int32_t width;
-    int32_t height;
-    uint16_t planes;
-    uint16_t bitCount;
-    uint32_t compression;
-    uint32_t sizeImage;
-    int32_t xPelsPerMeter;
-    int32_t yPelsPerMeter;
-    uint32_t colorsUsed;
-    uint32_t colorsImportant;
-};
-#pragma pack(pop)
-
-std::mutex mtx;
-std::ofstream logFile;
-
-void blurImage(const uint8_t* src, uint8_t* dst, int width, int height, int startX, int startY, int blockSize, int threadID, auto start) {
-    int endX = min(startX + blockSize, width);
-    int endY = min(startY + blockSize, height);
-
-    for (int y = startY; y < endY; ++y) {
-        for (int x = startX; x < endX; ++x) {
-            int sumR = 0, sumG = 0, sumB = 0;
-            int count = 0;
-            for (int dy = -1; dy <= 1; ++dy) {
-                for (int dx = -1; dx <= 1; ++dx) {
-                    int nx = x + dx;
-                    int ny = y + dy;
-                    if (nx >= 0 && nx < width && ny >= 0 && ny < height) {
-                        sumB += src[(ny * width + nx) * 3];
-                        sumG += src[(ny * width + nx) * 3 + 1];
-                        sumR += src[(ny * width + nx) * 3 + 2];
-                        count++;
-                    }
-                }
-            }
-            dst[(y * width + x) * 3] = sumB / count;
-            dst[(y * width + x) * 3 + 1] = sumG / count;
-            dst[(y * width + x) * 3 + 2] = sumR / count;
-
-            auto now = std::chrono::steady_clock::now();
-            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - start).count();
+void blurImage(const ImageView& src, const ImageView& dst, const Tile& tile, int threadID, TraceRing* trace) {
+    uint64_t begin = trace ? TraceClock::Now() : 0;
+    BoxBlurRect(src.data, dst.data, src.width, src.height, src.stride, tile.x0, tile.y0, tile.x1, tile.y1, 1);
+    if (trace) {
+        trace->Record(TraceEvent{ begin, TraceClock::Now(), uint32_t(threadID), uint32_t(tile.id), tile.x0, tile.y0, tile.x1, tile.y1 });
+    }
+}
 
-            std::lock_guard<std::mutex> lock(mtx);
-            logFile << ms << " ms, Thread: " << threadID  << ", Pixel: (" << x << ", " << y << ")" << std::endl;
-        }
+void processBlocks(ImageView src, ImageView dst, TileScheduler& scheduler, int threadID, TraceRing* trace) {
+    Tile tile;
+    while (scheduler.Next(threadID, tile)) {
+        blurImage(src, dst, tile, threadID, trace);
     }
 }
 
-void processBlocks(const uint8_t* src, uint8_t* dst, int width, int height, int blockSize, int blocksPerThread, int threadID) {
+// Один проход размытия всеми потоками; возвращает время в миллисекундах
+double runBlocks(const MappedBMP& srcImage, MappedBMP& dstImage, TileScheduler& scheduler, int numThreads, TraceRecorder* trace) {
     auto start = std::chrono::steady_clock::now();
+    std::vector<std::jthread> threads;
+    for (int i = 0; i < numThreads; ++i) {
+        threads.emplace_back(processBlocks, srcImage.Pixels(), dstImage.Pixels(), std::ref(scheduler), i,
+            trace ? &trace->Ring(i) : nullptr);
+    }
 
-    for (int i = 0; i < blocksPerThread; ++i) {
-        int blockX = (threadID * blocksPerThread + i) % (width / blockSize) * blockSize;
-        int blockY = (threadID * blocksPerThread + i) / (width / blockSize) * blockSize;
-        if (blockY < height) {
-            blurImage(src, dst, width, height, blockX, blockY, blockSize, threadID, start);
+    for (auto& t : threads) {
+        if (t.joinable()) {
+            t.join();
         }
     }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
 }
 
-int main(int argc, char* argv[]) {
-    if (argc < 4) {
-        std::cerr << "Usage: " << argv[0] << " <input.bmp> <output.bmp> <num_threads>" << std::endl;
-        return 1;
+// Сравнение порядков обхода: время и промахи кэша одного прохода для каждого порядка
+void printCacheStats(const MappedBMP& srcImage, MappedBMP& dstImage, int tileW, int tileH, int numThreads) {
+    for (TileOrder order : kAllTileOrders) {
+        std::vector<Tile> tiles = MakeTiles(srcImage.Width(), srcImage.Height(), tileW, tileH, order);
+        TileScheduler scheduler(tiles, numThreads);
+        CacheCounters counters;
+        counters.Start();
+        double ms = runBlocks(srcImage, dstImage, scheduler, numThreads, nullptr);
+        counters.Stop();
+        std::cout << TileOrderName(order) << ": " << ms << " ms";
+        for (int c = 0; c < CacheCounters::Count; ++c) {
+            std::cout << ", " << CacheCounters::Name(CacheCounters::Counter(c)) << " "
+                << counters.Format(CacheCounters::Counter(c));
+        }
+        std::cout << std::endl;
     }
+}
 
-    const char* inputFilename = argv[1];
-    const char* outputFilename = argv[2];
-    int numThreads = std::stoi(argv[3]);
-
-    std::ifstream inputFile(inputFilename, std::ios::binary);
-    if (!inputFile) {
-        std::cerr << "Error opening input file." << std::endl;
-        return 1;
+int main(int argc, char* argv[]) {
+    std::vector<std::string> args;
+    int tileW = 16, tileH = 16;
+    TileOrder order = TileOrder::Row;
+    std::string traceMode = "all";
+    bool heatmap = false;
+    bool cacheStats = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--tile=", 0) == 0) {
+            size_t x = arg.find('x', 7);
+            tileW = std::stoi(arg.substr(7, x - 7));
+            tileH = x == std::string::npos ? tileW : std::stoi(arg.substr(x + 1));
+        } else if (arg.rfind("--order=", 0) == 0) {
+            if (!ParseTileOrder(arg.substr(8), order)) {
+                std::cerr << "Unknown tile order: " << arg.substr(8) << std::endl;
+                return 1;
+            }
+        } else if (arg.rfind("--trace=", 0) == 0) {
+            traceMode = arg.substr(8);
+            if (traceMode != "off" && traceMode != "text" && traceMode != "chrome" && traceMode != "all") {
+                std::cerr << "Unknown trace mode: " << traceMode << std::endl;
+                return 1;
+            }
+        } else if (arg == "--heatmap") {
+            heatmap = true;
+        } else if (arg == "--cache-stats") {
+            cacheStats = true;
+        } else {
+            args.push_back(arg);
+        }
     }
 
-    BMPHeader bmpHeader;
-    DIBHeader dibHeader;
-    inputFile.read(reinterpret_cast<char*>(&bmpHeader), sizeof(bmpHeader));
-    inputFile.read(reinterpret_cast<char*>(&dibHeader), sizeof(dibHeader));
-
-    if (bmpHeader.fileType != 0x4D42) {
-        std::cerr << "Not a valid BMP file." << std::endl;
+    if (args.size() < 3 || tileW <= 0 || tileH <= 0) {
+        std::cerr << "Usage: " << argv[0] << " <input.bmp> <output.bmp> <num_threads> [--tile=N|WxH] [--order=row|column|serpentine|morton|hilbert]"
+            << " [--trace=off|text|chrome|all] [--heatmap] [--cache-stats]" << std::endl;
         return 1;
     }
 
-    int width = dibHeader.width;
-    int height = dibHeader.height;
-    int imageSize = width * height * 3;
-    std::vector<uint8_t> srcImage(imageSize);
-    std::vector<uint8_t> dstImage(imageSize);
-    inputFile.seekg(bmpHeader.offsetData, std::ios::beg);
-    inputFile.read(reinterpret_cast<char*>(srcImage.data()), imageSize);
-    inputFile.close();
+    const char* inputFilename = args[0].c_str();
+    const char* outputFilename = args[1].c_str();
+    int numThreads = std::stoi(args[2]);
 
-    logFile.open("log.txt");
-    if (!logFile) {
-        std::cerr << "Error opening log file." << std::endl;
-        return 1;
-    }
+    try {
+        MappedBMP srcImage = MappedBMP::Open(inputFilename);
+        MappedBMP dstImage = MappedBMP::CreateLike(outputFilename, srcImage);
+        if (cacheStats) {
+            printCacheStats(srcImage, dstImage, tileW, tileH, numThreads);
+        }
 
-    int blockSize = 16;
-    int numBlocks = (width * height) / (blockSize * blockSize);
-    int blocksPerThread = numBlocks / numThreads;
+        std::vector<Tile> tiles = MakeTiles(srcImage.Width(), srcImage.Height(), tileW, tileH, order);
+        TileScheduler scheduler(tiles, numThreads);
 
-    std::vector<std::jthread> threads;
-    for (int i = 0; i < numThreads; ++i) {
-        threads.emplace_back(processBlocks, srcImage.data(), dstImage.data(), width, height, blockSize, blocksPerThread, i);
-    }
-
-    for (auto& t : threads) {
-        if (t.joinable()) {
-            t.join();
+        std::unique_ptr<TraceRecorder> trace;
+        if (traceMode != "off" || heatmap) {
+            trace = std::make_unique<TraceRecorder>(numThreads, TraceEventsPerThread(tiles.size(), unsigned(numThreads)));
         }
-    }
 
-    logFile.close();
+        runBlocks(srcImage, dstImage, scheduler, numThreads, trace.get());
 
-    std::ofstream outputFile(outputFilename, std::ios::binary);
-    if (!outputFile) {
-        std::cerr << "Error opening output file." << std::endl;
+        if (trace) {
+            if (traceMode == "text" || traceMode == "all") {
+                trace->WriteText("log.txt");
+            }
+            if (traceMode == "chrome" || traceMode == "all") {
+                trace->WriteChromeJson("trace.json");
+            }
+            if (heatmap) {
+                std::vector<TraceEvent> events = trace->Merge();
+                double nsPerTick = trace->NsPerTick();
+                WriteHeatmaps(outputFilename, srcImage.Width(), srcImage.Height(), events, nsPerTick);
+
+                std::filesystem::path base(outputFilename);
+                std::ofstream summary((base.parent_path() / base.stem()).string() + "_summary.txt");
+                WriteThreadSummary(summary, numThreads, events, nsPerTick);
+                WriteThreadSummary(std::cout, numThreads, events, nsPerTick);
+            }
+            if (trace->Dropped() > 0) {
+                std::cerr << "Trace events dropped: " << trace->Dropped() << std::endl;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
         return 1;
     }
-    outputFile.write(reinterpret_cast<char*>(&bmpHeader), sizeof(bmpHeader));
-    outputFile.write(reinterpret_cast<char*>(&dibHeader), sizeof(dibHeader));
-    outputFile.seekp(bmpHeader.offsetData, std::ios::beg);
-    outputFile.write(reinterpret_cast<char*>(dstImage.data()), imageSize);
-    outputFile.close();
 
     std::cout << "Blurring complete and log saved!" << std::endl;
     return 0;